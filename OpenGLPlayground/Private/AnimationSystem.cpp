@@ -0,0 +1,350 @@
+#include "AnimationSystem.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ANIMATION_SSE
+#endif
+
+namespace
+{
+	constexpr int CHANNEL_BATCH_SIZE = 1024; // channels or nodes per job, a multiple of 4
+	constexpr float ARC_EPSILON = 1e-4f; // rotation keys closer than this are interpolated linearly
+
+#ifdef ANIMATION_SSE
+	// sine and cosine of 4 angles, to about 1e-7 for angles up to a few thousand radians
+	// the angle is reduced to [-pi/4, pi/4] around the nearest multiple of pi/2, whose parity picks
+	// which polynomial gives the sine, and whose quadrant the signs
+	inline void sinCos4(__m128 x, __m128& s, __m128& c)
+	{
+		__m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.63661977f))); // x * 2 / pi, rounded
+		__m128 q = _mm_cvtepi32_ps(quadrant);
+
+		// pi / 2 in three parts, so that q * the first part is exact
+		__m128 r = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(1.5703125f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(4.837512969970703125e-4f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(q, _mm_set1_ps(7.54978995489188216e-8f)));
+		__m128 r2 = _mm_mul_ps(r, r);
+
+		__m128 sinPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-1.9515295891e-4f), r2), _mm_set1_ps(8.3321608736e-3f));
+		sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, r2), _mm_set1_ps(-1.6666654611e-1f));
+		sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, r2), r), r);
+
+		__m128 cosPoly = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.443315711809948e-5f), r2), _mm_set1_ps(-1.388731625493765e-3f));
+		cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, r2), _mm_set1_ps(4.166664568298827e-2f));
+		cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, r2), r2);
+		cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(r2, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+		// odd quadrants swap the two, quadrants 2 and 3 negate the sine, 1 and 2 the cosine
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+		__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30));
+		__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+		s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly)), sinSign);
+		c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly)), cosSign);
+	}
+#endif
+}
+
+AnimationSystem::AnimationSystem()
+	: packed{ true }
+{
+}
+
+int AnimationSystem::addTranslationCurve(const std::vector<float>& times, const std::vector<glm::vec3>& translations)
+{
+	std::vector<glm::vec4> values;
+	for (const glm::vec3& translation : translations)
+	{
+		values.push_back(glm::vec4(translation, 0.0f));
+	}
+	return addCurve(times, values, false);
+}
+
+int AnimationSystem::addRotationCurve(const std::vector<float>& times, const std::vector<glm::quat>& rotations)
+{
+	// each key on the same side as the one before it, the slerp between them then takes the short way
+	std::vector<glm::vec4> values;
+	for (const glm::quat& rotation : rotations)
+	{
+		glm::vec4 value(rotation.x, rotation.y, rotation.z, rotation.w);
+		values.push_back(!values.empty() && glm::dot(values.back(), value) < 0.0f ? -value : value);
+	}
+	return addCurve(times, values, true);
+}
+
+int AnimationSystem::addCurve(const std::vector<float>& times, const std::vector<glm::vec4>& values, bool rotation)
+{
+	curves.push_back({ (int)keyTimes.size(), (int)times.size(), rotation });
+	keyTimes.insert(keyTimes.end(), times.begin(), times.end());
+	keyValues.insert(keyValues.end(), values.begin(), values.end());
+	for (int key = 0; key < (int)values.size(); key++)
+	{
+		float angle = 0.0f;
+		if (rotation && key + 1 < (int)values.size())
+		{
+			angle = acosf(glm::clamp(glm::dot(values[key], values[key + 1]), -1.0f, 1.0f));
+		}
+		keyArcs.push_back(glm::vec2(angle, angle > ARC_EPSILON ? 1.0f / sinf(angle) : 0.0f));
+	}
+	return (int)curves.size() - 1;
+}
+
+int AnimationSystem::addNode(int node, const Transform& base)
+{
+	nodes.push_back(node);
+	scales.push_back(base.scale);
+	tx.push_back(base.translation.x);
+	ty.push_back(base.translation.y);
+	tz.push_back(base.translation.z);
+	qx.push_back(base.rotation.x);
+	qy.push_back(base.rotation.y);
+	qz.push_back(base.rotation.z);
+	qw.push_back(base.rotation.w);
+	return (int)nodes.size() - 1;
+}
+
+void AnimationSystem::truncate(int numAnimated)
+{
+	for (std::vector<float>* field : { &scales, &tx, &ty, &tz, &qx, &qy, &qz, &qw })
+	{
+		field->resize(numAnimated);
+	}
+	nodes.resize(numAnimated);
+
+	orbits.erase(std::remove_if(orbits.begin(), orbits.end(), [&](const Orbit& orbit) { return orbit.target >= numAnimated; }), orbits.end());
+	spins.erase(std::remove_if(spins.begin(), spins.end(), [&](const Spin& spin) { return spin.target >= numAnimated; }), spins.end());
+	auto dropped = [&](const Track& track) { return track.target >= numAnimated; };
+	translationTracks.erase(std::remove_if(translationTracks.begin(), translationTracks.end(), dropped), translationTracks.end());
+	rotationTracks.erase(std::remove_if(rotationTracks.begin(), rotationTracks.end(), dropped), rotationTracks.end());
+	packed = false;
+}
+
+void AnimationSystem::addOrbit(int animated, const glm::vec3& center, const glm::vec3& cosAxis, const glm::vec3& sinAxis, float speed, float phase)
+{
+	orbits.push_back({ animated, center, cosAxis, sinAxis, speed, phase });
+	packed = false;
+}
+
+void AnimationSystem::addSpin(int animated, const glm::vec3& axis, float speed, float phase)
+{
+	spins.push_back({ animated, glm::normalize(axis), speed, phase });
+	packed = false;
+}
+
+void AnimationSystem::addTranslationTrack(int animated, int curve, float speed, float offset)
+{
+	translationTracks.push_back({ animated, curve, speed, offset, 0 });
+}
+
+void AnimationSystem::addRotationTrack(int animated, int curve, float speed, float offset)
+{
+	rotationTracks.push_back({ animated, curve, speed, offset, 0 });
+}
+
+void AnimationSystem::pack()
+{
+	int numOrbitLanes = ((int)orbits.size() + 3) / 4 * 4;
+	orbitTargets.assign(numOrbitLanes, -1);
+	for (std::vector<float>* field : { &orbitCx, &orbitCy, &orbitCz, &orbitAx, &orbitAy, &orbitAz, &orbitBx, &orbitBy, &orbitBz, &orbitSpeeds, &orbitPhases })
+	{
+		field->assign(numOrbitLanes, 0.0f);
+	}
+	for (int i = 0; i < (int)orbits.size(); i++)
+	{
+		const Orbit& orbit = orbits[i];
+		orbitTargets[i] = orbit.target;
+		orbitCx[i] = orbit.center.x;
+		orbitCy[i] = orbit.center.y;
+		orbitCz[i] = orbit.center.z;
+		orbitAx[i] = orbit.cosAxis.x;
+		orbitAy[i] = orbit.cosAxis.y;
+		orbitAz[i] = orbit.cosAxis.z;
+		orbitBx[i] = orbit.sinAxis.x;
+		orbitBy[i] = orbit.sinAxis.y;
+		orbitBz[i] = orbit.sinAxis.z;
+		orbitSpeeds[i] = orbit.speed;
+		orbitPhases[i] = orbit.phase;
+	}
+
+	int numSpinLanes = ((int)spins.size() + 3) / 4 * 4;
+	spinTargets.assign(numSpinLanes, -1);
+	for (std::vector<float>* field : { &spinX, &spinY, &spinZ, &spinSpeeds, &spinPhases })
+	{
+		field->assign(numSpinLanes, 0.0f);
+	}
+	for (int i = 0; i < (int)spins.size(); i++)
+	{
+		const Spin& spin = spins[i];
+		spinTargets[i] = spin.target;
+		spinX[i] = spin.axis.x;
+		spinY[i] = spin.axis.y;
+		spinZ[i] = spin.axis.z;
+		spinSpeeds[i] = spin.speed;
+		spinPhases[i] = spin.phase;
+	}
+	packed = true;
+}
+
+void AnimationSystem::evaluate(double time, TransformHierarchy& transforms, JobSystem& jobs)
+{
+	if (!packed)
+	{
+		pack();
+	}
+
+	// each channel writes its own node's fields, so the batches of one kind never touch the same memory
+	float t = (float)time;
+	jobs.parallelFor((int)orbitTargets.size(), CHANNEL_BATCH_SIZE, [&](int begin, int end) { evaluateOrbits(begin, end, t); });
+	jobs.parallelFor((int)spinTargets.size(), CHANNEL_BATCH_SIZE, [&](int begin, int end) { evaluateSpins(begin, end, t); });
+	jobs.parallelFor((int)translationTracks.size(), CHANNEL_BATCH_SIZE, [&](int begin, int end) { evaluateTracks(translationTracks, begin, end, t); });
+	jobs.parallelFor((int)rotationTracks.size(), CHANNEL_BATCH_SIZE, [&](int begin, int end) { evaluateTracks(rotationTracks, begin, end, t); });
+
+	jobs.parallelFor((int)nodes.size(), CHANNEL_BATCH_SIZE, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			transforms.setLocal(nodes[i], Transform(glm::vec3(tx[i], ty[i], tz[i]), glm::quat(qw[i], qx[i], qy[i], qz[i]), scales[i]));
+		}
+	});
+}
+
+void AnimationSystem::evaluateOrbits(int begin, int end, float time)
+{
+	for (int i = begin; i < end; i += 4)
+	{
+		float x[4], y[4], z[4];
+#ifdef ANIMATION_SSE
+		__m128 angle = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&orbitSpeeds[i]), _mm_set1_ps(time)), _mm_loadu_ps(&orbitPhases[i]));
+		__m128 s, c;
+		sinCos4(angle, s, c);
+		auto along = [&](const std::vector<float>& center, const std::vector<float>& cosAxis, const std::vector<float>& sinAxis)
+		{
+			return _mm_add_ps(_mm_loadu_ps(&center[i]),
+				_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&cosAxis[i]), c), _mm_mul_ps(_mm_loadu_ps(&sinAxis[i]), s)));
+		};
+		_mm_storeu_ps(x, along(orbitCx, orbitAx, orbitBx));
+		_mm_storeu_ps(y, along(orbitCy, orbitAy, orbitBy));
+		_mm_storeu_ps(z, along(orbitCz, orbitAz, orbitBz));
+#else
+		for (int lane = 0; lane < 4; lane++)
+		{
+			int k = i + lane;
+			float angle = orbitSpeeds[k] * time + orbitPhases[k];
+			float s = sinf(angle);
+			float c = cosf(angle);
+			x[lane] = orbitCx[k] + orbitAx[k] * c + orbitBx[k] * s;
+			y[lane] = orbitCy[k] + orbitAy[k] * c + orbitBy[k] * s;
+			z[lane] = orbitCz[k] + orbitAz[k] * c + orbitBz[k] * s;
+		}
+#endif
+		for (int lane = 0; lane < 4; lane++)
+		{
+			int target = orbitTargets[i + lane];
+			if (target >= 0)
+			{
+				tx[target] = x[lane];
+				ty[target] = y[lane];
+				tz[target] = z[lane];
+			}
+		}
+	}
+}
+
+void AnimationSystem::evaluateSpins(int begin, int end, float time)
+{
+	for (int i = begin; i < end; i += 4)
+	{
+		// the quaternion of a rotation by angle about a unit axis is (axis sin(angle / 2), cos(angle / 2))
+		float x[4], y[4], z[4], w[4];
+#ifdef ANIMATION_SSE
+		__m128 halfAngle = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&spinSpeeds[i]), _mm_set1_ps(time)), _mm_loadu_ps(&spinPhases[i])), _mm_set1_ps(0.5f));
+		__m128 s, c;
+		sinCos4(halfAngle, s, c);
+		_mm_storeu_ps(x, _mm_mul_ps(_mm_loadu_ps(&spinX[i]), s));
+		_mm_storeu_ps(y, _mm_mul_ps(_mm_loadu_ps(&spinY[i]), s));
+		_mm_storeu_ps(z, _mm_mul_ps(_mm_loadu_ps(&spinZ[i]), s));
+		_mm_storeu_ps(w, c);
+#else
+		for (int lane = 0; lane < 4; lane++)
+		{
+			int k = i + lane;
+			float halfAngle = (spinSpeeds[k] * time + spinPhases[k]) * 0.5f;
+			float s = sinf(halfAngle);
+			x[lane] = spinX[k] * s;
+			y[lane] = spinY[k] * s;
+			z[lane] = spinZ[k] * s;
+			w[lane] = cosf(halfAngle);
+		}
+#endif
+		for (int lane = 0; lane < 4; lane++)
+		{
+			int target = spinTargets[i + lane];
+			if (target >= 0)
+			{
+				qx[target] = x[lane];
+				qy[target] = y[lane];
+				qz[target] = z[lane];
+				qw[target] = w[lane];
+			}
+		}
+	}
+}
+
+void AnimationSystem::evaluateTracks(std::vector<Track>& tracks, int begin, int end, float time)
+{
+	for (int i = begin; i < end; i++)
+	{
+		Track& track = tracks[i];
+		const Curve& curve = curves[track.curve];
+		const float* times = &keyTimes[curve.firstKey];
+		const glm::vec4* values = &keyValues[curve.firstKey];
+		const glm::vec2* arcs = &keyArcs[curve.firstKey];
+
+		glm::vec4 value = values[0];
+		if (curve.numKeys > 1)
+		{
+			float duration = times[curve.numKeys - 1];
+			float localTime = time * track.speed + track.offset;
+			localTime = glm::clamp(localTime - floorf(localTime / duration) * duration, 0.0f, duration);
+
+			// time mostly moves forward by less than a segment, so the cursor stays or moves by one;
+			// it starts over when the loop wraps around or time goes back
+			int cursor = times[track.cursor] <= localTime ? track.cursor : 0;
+			while (cursor < curve.numKeys - 2 && times[cursor + 1] <= localTime)
+			{
+				cursor++;
+			}
+			track.cursor = cursor;
+
+			float a = glm::clamp((localTime - times[cursor]) / (times[cursor + 1] - times[cursor]), 0.0f, 1.0f);
+			const glm::vec4& from = values[cursor];
+			const glm::vec4& to = values[cursor + 1];
+			const glm::vec2& arc = arcs[cursor];
+			if (curve.rotation && arc.x > ARC_EPSILON)
+			{
+				value = from * (sinf((1.0f - a) * arc.x) * arc.y) + to * (sinf(a * arc.x) * arc.y);
+			}
+			else
+			{
+				value = glm::mix(from, to, a);
+				value = curve.rotation ? glm::normalize(value) : value;
+			}
+		}
+
+		int target = track.target;
+		if (curve.rotation)
+		{
+			qx[target] = value.x;
+			qy[target] = value.y;
+			qz[target] = value.z;
+			qw[target] = value.w;
+		}
+		else
+		{
+			tx[target] = value.x;
+			ty[target] = value.y;
+			tz[target] = value.z;
+		}
+	}
+}
@@ -0,0 +1,178 @@
+#include <cmath>
+#include <iostream>
+#include <vector>
+#include "GLState.h"
+#include "Utils.h"
+#include "ComputeMeshGenerator.h"
+
+constexpr GLuint WORKGROUP_SIZE = 64; // local_size_x of the generator shaders
+
+ComputeMeshGenerator::ComputeMeshGenerator()
+{
+}
+
+void ComputeMeshGenerator::init()
+{
+	std::string resourcePath = Utils::getResourcePath();
+	sphereProgram.createCompute((resourcePath + "sphereGenShader.glsl").c_str());
+	torusProgram.createCompute((resourcePath + "torusGenShader.glsl").c_str());
+	stripProgram.createCompute((resourcePath + "gridStripShader.glsl").c_str());
+
+	sphSlicesLoc = sphereProgram.uniform("numSlices");
+	sphStrideLoc = sphereProgram.uniform("vertexStride");
+	torRingsLoc = torusProgram.uniform("numRings");
+	torInnerLoc = torusProgram.uniform("innerRadius");
+	torOuterLoc = torusProgram.uniform("outerRadius");
+	torStrideLoc = torusProgram.uniform("vertexStride");
+	stripColsLoc = stripProgram.uniform("numCols");
+	stripRowsLoc = stripProgram.uniform("numRows");
+	stripNextRowLoc = stripProgram.uniform("nextRowFirst");
+	stripShortLoc = stripProgram.uniform("shortIndices");
+	stripFirstWordLoc = stripProgram.uniform("firstWord");
+}
+
+GeometryRange ComputeMeshGenerator::createSphere(int numSlices, VertexFormat format)
+{
+	GeometryRange range = allocate(numSlices, format);
+	generateStrip(range, numSlices, true); // same winding as Sphere
+	generateSphere(range, numSlices);
+	return range;
+}
+
+GeometryRange ComputeMeshGenerator::createTorus(float innerRadius, float outerRadius, int numRings, VertexFormat format)
+{
+	GeometryRange range = allocate(numRings, format);
+	generateStrip(range, numRings, false); // same winding as Torus
+	generateTorus(range, innerRadius, outerRadius, numRings);
+	return range;
+}
+
+void ComputeMeshGenerator::destroy(GeometryRange& range)
+{
+	GLState::deleteBuffers(1, &range.buffer);
+	range.buffer = 0;
+}
+
+void ComputeMeshGenerator::generateSphere(const GeometryRange& range, int numSlices)
+{
+	GLState::useProgram(sphereProgram.getId());
+	glUniform1i(sphSlicesLoc, numSlices);
+	glUniform1i(sphStrideLoc, range.vertexStride / (GLsizei)sizeof(float));
+	GLState::bindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, range.buffer, 0, range.indexOffset);
+	glDispatchCompute((range.numVertices + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	// the vertices are read as attributes next
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+void ComputeMeshGenerator::generateTorus(const GeometryRange& range, float innerRadius, float outerRadius, int numRings)
+{
+	GLState::useProgram(torusProgram.getId());
+	glUniform1i(torRingsLoc, numRings);
+	glUniform1f(torInnerLoc, innerRadius);
+	glUniform1f(torOuterLoc, outerRadius);
+	glUniform1i(torStrideLoc, range.vertexStride / (GLsizei)sizeof(float));
+	GLState::bindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, range.buffer, 0, range.indexOffset);
+	glDispatchCompute((range.numVertices + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+bool ComputeMeshGenerator::validate()
+{
+	GeometryRange sphere = createSphere(48, VertexFormat::PosTexNorm);
+	GeometryRange torus = createTorus(0.5f, 0.2f, 48, VertexFormat::PosTexNorm);
+	GeometryRange torusDepth = createTorus(0.5f, 0.2f, 48, VertexFormat::Pos);
+
+	GeometryRange cpuSphere = GeometryCache::createSphere(48, VertexFormat::PosTexNorm);
+	GeometryRange cpuTorus = GeometryCache::createTorus(0.5f, 0.2f, 48, VertexFormat::PosTexNorm);
+	GeometryRange cpuTorusDepth = GeometryCache::createTorus(0.5f, 0.2f, 48, VertexFormat::Pos);
+
+	bool valid = compare("sphere", &cpuSphere, sphere);
+	valid = compare("torus", &cpuTorus, torus) && valid;
+	valid = compare("torus (position only)", &cpuTorusDepth, torusDepth) && valid;
+
+	destroy(cpuSphere);
+	destroy(cpuTorus);
+	destroy(cpuTorusDepth);
+	destroy(sphere);
+	destroy(torus);
+	destroy(torusDepth);
+	return valid;
+}
+
+GeometryRange ComputeMeshGenerator::allocate(int gridSize, VertexFormat format)
+{
+	// same layout GeometryCache::upload produces for a grid strip
+	GeometryRange range;
+	range.format = format;
+	range.numVertices = (gridSize + 1) * (gridSize + 1);
+	range.vertexStride = (format == VertexFormat::PosTexNorm ? 8 : 3) * sizeof(float);
+	range.mode = GL_TRIANGLE_STRIP;
+	range.numIndices = gridSize * (2 * (gridSize + 1) + 1) - 1;
+	range.indexType = range.numVertices < 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	range.indexOffset = range.numVertices * range.vertexStride; // already 4-byte aligned
+	GLsizeiptr indexSize = range.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	range.bytes = range.indexOffset + ((range.numIndices * indexSize + 3) & ~(GLsizeiptr)3);
+
+	glGenBuffers(1, &range.buffer);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, range.buffer);
+	glBufferData(GL_ARRAY_BUFFER, range.bytes, NULL, GL_DYNAMIC_DRAW);
+	return range;
+}
+
+void ComputeMeshGenerator::generateStrip(const GeometryRange& range, int gridSize, bool nextRowFirst)
+{
+	bool shortIndices = range.indexType == GL_UNSIGNED_SHORT;
+	GLuint numWords = shortIndices ? (range.numIndices + 1) / 2 : range.numIndices;
+
+	GLState::useProgram(stripProgram.getId());
+	glUniform1i(stripColsLoc, gridSize);
+	glUniform1i(stripRowsLoc, gridSize);
+	glUniform1i(stripNextRowLoc, nextRowFirst);
+	glUniform1i(stripShortLoc, shortIndices);
+	glUniform1i(stripFirstWordLoc, (GLint)(range.indexOffset / sizeof(GLuint)));
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, range.buffer);
+	glDispatchCompute((numWords + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	glMemoryBarrier(GL_ELEMENT_ARRAY_BARRIER_BIT);
+}
+
+bool ComputeMeshGenerator::compare(const char* name, const GeometryRange* expected, const GeometryRange& actual)
+{
+	if (expected->numVertices != actual.numVertices || expected->numIndices != actual.numIndices
+		|| expected->indexType != actual.indexType || expected->vertexStride != actual.vertexStride)
+	{
+		std::cout << "compute " << name << ": layout differs from the CPU generator" << std::endl;
+		return false;
+	}
+
+	// read both ranges back, the buffer update barrier orders this after the compute writes
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	int numFloats = (int)(actual.indexOffset / sizeof(float));
+	std::vector<float> expectedVals(numFloats), actualVals(numFloats);
+	GLState::bindBuffer(GL_COPY_READ_BUFFER, expected->buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, numFloats * sizeof(float), &expectedVals[0]);
+	GLState::bindBuffer(GL_COPY_READ_BUFFER, actual.buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, 0, numFloats * sizeof(float), &actualVals[0]);
+
+	float maxError = 0.0f;
+	for (int i = 0; i < numFloats; i++)
+	{
+		maxError = std::fmax(maxError, std::fabs(expectedVals[i] - actualVals[i]));
+	}
+
+	GLsizeiptr indexBytes = actual.numIndices * (actual.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+	std::vector<unsigned char> expectedIdxs(indexBytes), actualIdxs(indexBytes);
+	GLState::bindBuffer(GL_COPY_READ_BUFFER, expected->buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, expected->indexOffset, indexBytes, &expectedIdxs[0]);
+	GLState::bindBuffer(GL_COPY_READ_BUFFER, actual.buffer);
+	glGetBufferSubData(GL_COPY_READ_BUFFER, actual.indexOffset, indexBytes, &actualIdxs[0]);
+	bool indicesMatch = expectedIdxs == actualIdxs;
+
+	// the GPU's trig functions may differ from the CPU's in the last few bits
+	bool valid = indicesMatch && maxError < 1e-4f;
+	std::cout << "compute " << name << ": max vertex error " << maxError << ", indices "
+		<< (indicesMatch ? "match" : "differ") << (valid ? " -- OK" : " -- MISMATCH") << std::endl;
+	return valid;
+}
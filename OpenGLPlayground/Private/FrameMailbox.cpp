@@ -0,0 +1,54 @@
+#include "FrameMailbox.h"
+#include <chrono>
+
+FrameMailbox::FrameMailbox()
+	: ready{ -1 }
+	, reading{ -1 }
+	, closed{ false }
+{
+}
+
+int FrameMailbox::beginWrite()
+{
+	// at most one frame waits for the render thread, the update thread never runs further ahead
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [&] { return ready < 0 || closed; });
+	if (closed)
+	{
+		return -1;
+	}
+	return reading == 0 ? 1 : 0;
+}
+
+void FrameMailbox::publish(int slot)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ready = slot;
+	}
+	changed.notify_all();
+}
+
+int FrameMailbox::acquire(double timeoutSeconds)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait_for(lock, std::chrono::duration<double>(timeoutSeconds), [&] { return ready >= 0 || closed; });
+	if (ready < 0 || closed)
+	{
+		return -1;
+	}
+	reading = ready;
+	ready = -1;
+	lock.unlock();
+	changed.notify_all(); // the slot read until now is free for the update thread
+	return reading;
+}
+
+void FrameMailbox::close()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+	}
+	changed.notify_all();
+}
@@ -0,0 +1,98 @@
+#include "FramePacer.h"
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+FramePacer::FramePacer()
+	: sleepOvershoot{ Clock::duration::zero() }
+	, frameInterval{ 0.0 }
+	, lastCpuTime{ 0.0 }
+	, swapInterval{ 0 }
+	, targetFps{ 0.0 }
+	, started{ false }
+{
+}
+
+void FramePacer::setSwapInterval(int interval)
+{
+	swapInterval = interval;
+	glfwSwapInterval(interval);
+}
+
+void FramePacer::setTargetFps(double fps)
+{
+	targetFps = fps;
+	nextFrame = Clock::now();
+}
+
+void FramePacer::endFrame(FrameStats& stats)
+{
+	double waited = wait();
+	Clock::time_point now = Clock::now();
+	double cpuTime = getProcessCpuTime();
+	if (started)
+	{
+		double interval = std::chrono::duration<double>(now - lastFrame).count();
+		stats.addTime("pacing wait", waited * 1000.0);
+		stats.addTime("frame jitter", std::abs(interval - frameInterval) * 1000.0);
+		stats.addCount("cpu %", (cpuTime - lastCpuTime) / interval * 100.0); // 100 for each core kept busy
+		frameInterval = interval;
+	}
+	lastFrame = now;
+	lastCpuTime = cpuTime;
+	started = true;
+}
+
+double FramePacer::wait()
+{
+	if (targetFps <= 0.0)
+	{
+		return 0.0;
+	}
+
+	// a frame that ran late starts the schedule again from now, the next ones are not rushed to catch up
+	Clock::time_point start = Clock::now();
+	nextFrame += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFps));
+	if (nextFrame < start)
+	{
+		nextFrame = start;
+	}
+
+	// sleeps may take a scheduler tick longer than asked, so they stop that far ahead and the rest is spun;
+	// the overshoot decays, one sleep that was preempted does not make every later wait spin longer
+	while (nextFrame - Clock::now() > sleepOvershoot)
+	{
+		Clock::time_point before = Clock::now();
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		sleepOvershoot = std::max(Clock::now() - before, sleepOvershoot - sleepOvershoot / 64);
+	}
+	while (Clock::now() < nextFrame)
+	{
+		std::this_thread::yield();
+	}
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double FramePacer::getProcessCpuTime()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+	auto ticks = [](const FILETIME& time) { return ((unsigned long long)time.dwHighDateTime << 32) | time.dwLowDateTime; };
+	return (ticks(kernel) + ticks(user)) * 1e-7; // 100 ns ticks
+#else
+	timespec time;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time);
+	return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
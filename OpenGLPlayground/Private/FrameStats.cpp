@@ -0,0 +1,95 @@
+#include "FrameStats.h"
+#include <iostream>
+
+FrameStats::FrameStats(double reportInterval)
+	: interval{ reportInterval }
+	, lastReport{ -1.0 }
+	, numFrames{ 0 }
+	, enabled{ false }
+{
+}
+
+void FrameStats::addTime(const char* name, double milliseconds)
+{
+	find(name, true).sum += milliseconds;
+}
+
+void FrameStats::addCount(const char* name, double value)
+{
+	find(name, false).sum += value;
+}
+
+void FrameStats::endFrame(double currentTime)
+{
+	numFrames++;
+	if (lastReport < 0.0)
+	{
+		lastReport = currentTime;
+	}
+	if (currentTime - lastReport < interval)
+	{
+		return;
+	}
+
+	if (enabled)
+	{
+		std::cout << "frame stats (" << numFrames << " frames):";
+		for (Entry& entry : entries)
+		{
+			std::cout << "  " << entry.name << " " << entry.sum / numFrames << (entry.isTime ? " ms" : "");
+		}
+		std::cout << std::endl;
+	}
+
+	clear();
+	numFrames = 0;
+	lastReport = currentTime;
+}
+
+void FrameStats::merge(const FrameStats& other)
+{
+	for (const Entry& entry : other.entries)
+	{
+		find(entry.name.c_str(), entry.isTime).sum += entry.sum;
+	}
+}
+
+void FrameStats::clear()
+{
+	for (Entry& entry : entries)
+	{
+		entry.sum = 0.0;
+	}
+}
+
+void FrameStats::setEnabled(bool enable)
+{
+	enabled = enable;
+}
+
+FrameStats::Entry& FrameStats::find(const char* name, bool isTime)
+{
+	// a handful of entries, a linear search is cheaper than hashing the name
+	for (Entry& entry : entries)
+	{
+		if (entry.name == name)
+		{
+			return entry;
+		}
+	}
+	entries.push_back({ name, 0.0, isTime });
+	return entries.back();
+}
+
+ScopedTimer::ScopedTimer(FrameStats& frameStats, const char* timerName)
+	: stats{ frameStats }
+	, name{ timerName }
+	, start{ std::chrono::high_resolution_clock::now() }
+{
+}
+
+ScopedTimer::~ScopedTimer()
+{
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	stats.addTime(name, elapsed.count());
+}
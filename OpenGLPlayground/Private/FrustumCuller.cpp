@@ -0,0 +1,118 @@
+#include "FrustumCuller.h"
+#include <limits>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4& viewProjection)
+{
+	// clip-space bounds -w <= x, y, z <= w as sums and differences of the matrix rows
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++)
+	{
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+
+	Frustum frustum;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		frustum.planes[axis * 2] = rows[3] + rows[axis];
+		frustum.planes[axis * 2 + 1] = rows[3] - rows[axis];
+	}
+	for (glm::vec4& plane : frustum.planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+	return frustum;
+}
+
+FrustumCuller::FrustumCuller()
+	: count{ 0 }
+{
+}
+
+void FrustumCuller::clear()
+{
+	xs.clear();
+	ys.clear();
+	zs.clear();
+	radii.clear();
+	count = 0;
+}
+
+void FrustumCuller::add(const glm::vec3& center, float radius)
+{
+	if (count == (int)xs.size())
+	{
+		// a padding sphere would need a distance of at least +infinity to pass
+		xs.resize(count + 4, 0.0f);
+		ys.resize(count + 4, 0.0f);
+		zs.resize(count + 4, 0.0f);
+		radii.resize(count + 4, -std::numeric_limits<float>::infinity());
+	}
+	xs[count] = center.x;
+	ys[count] = center.y;
+	zs[count] = center.z;
+	radii[count] = radius;
+	count++;
+}
+
+void FrustumCuller::cull(const Frustum& frustum, std::vector<int>& visible) const
+{
+	// room for every sphere up front, trimmed to the survivors at the end
+	size_t first = visible.size();
+	visible.resize(first + xs.size());
+	int* out = &visible[0] + first;
+
+#ifdef FRUSTUM_CULLER_SSE
+	__m128 planes[6][4];
+	for (int p = 0; p < 6; p++)
+	{
+		for (int c = 0; c < 4; c++)
+		{
+			planes[p][c] = _mm_set1_ps(frustum.planes[p][c]);
+		}
+	}
+
+	for (int i = 0; i < (int)xs.size(); i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&xs[i]);
+		__m128 y = _mm_loadu_ps(&ys[i]);
+		__m128 z = _mm_loadu_ps(&zs[i]);
+		__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radii[i]));
+
+		// a sphere is outside as soon as its center is further than its radius behind any plane
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++)
+		{
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)),
+				_mm_add_ps(_mm_mul_ps(planes[p][2], z), planes[p][3]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negRadius));
+		}
+
+		// every lane is written, only the inside ones advance
+		int mask = _mm_movemask_ps(inside);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			*out = i + lane;
+			out += (mask >> lane) & 1;
+		}
+	}
+#else
+	for (int i = 0; i < count; i++)
+	{
+		glm::vec3 center(xs[i], ys[i], zs[i]);
+		bool inside = true;
+		for (int p = 0; p < 6 && inside; p++)
+		{
+			inside = glm::dot(glm::vec3(frustum.planes[p]), center) + frustum.planes[p].w >= -radii[i];
+		}
+		*out = i;
+		out += inside ? 1 : 0;
+	}
+#endif
+	visible.resize(out - &visible[0]);
+}
@@ -0,0 +1,385 @@
+#include "GLState.h"
+
+namespace
+{
+	constexpr GLuint UNKNOWN = 0xFFFFFFFF;
+	constexpr int MAX_TARGETS = 16;
+	constexpr int MAX_TEXTURE_UNITS = 32;
+
+	struct BufferBinding
+	{
+		GLenum target;
+		GLuint index;  // indexed bindings only
+		GLuint buffer;
+		GLintptr offset;
+		GLsizeiptr size; // -1 for a whole buffer bound by bindBufferBase()
+	};
+
+	struct Capability
+	{
+		GLenum capability;
+		int enabled; // -1 unknown
+	};
+
+	// what the application last set, with UNKNOWN where it has not or invalidate() was called since;
+	// the few targets, indices and capabilities in use are kept in small arrays and searched linearly
+	struct State
+	{
+		GLuint program;
+		GLuint vertexArray;
+		BufferBinding buffers[MAX_TARGETS];
+		int numBuffers;
+		BufferBinding indexedBuffers[MAX_TARGETS];
+		int numIndexedBuffers;
+		GLenum activeUnit;
+		GLuint textures[MAX_TEXTURE_UNITS];
+		Capability capabilities[MAX_TARGETS];
+		int numCapabilities;
+		GLenum frontFace;
+		GLenum cullFace;
+		GLuint colorMask;
+		GLenum depthFunc;
+		GLuint depthMask;
+	};
+
+	const char* issuedNames[GLState::NUM_CATEGORIES] = {
+		"program binds", "buffer binds", "texture binds", "vertex array binds", "raster state", "depth state" };
+	const char* filteredNames[GLState::NUM_CATEGORIES] = {
+		"program binds filtered", "buffer binds filtered", "texture binds filtered", "vertex array binds filtered",
+		"raster state filtered", "depth state filtered" };
+
+	State state;
+	bool stateValid = false;
+	bool filtering = true;
+	int numIssued[GLState::NUM_CATEGORIES];
+	int numFiltered[GLState::NUM_CATEGORIES];
+
+	State& current()
+	{
+		if (!stateValid)
+		{
+			GLState::invalidate();
+		}
+		return state;
+	}
+
+	// counts the call and tells whether it has to reach GL; value is updated to wanted either way
+	template <typename T>
+	bool change(GLState::Category category, T& value, T wanted)
+	{
+		if (filtering && value == wanted)
+		{
+			numFiltered[category]++;
+			return false;
+		}
+		value = wanted;
+		numIssued[category]++;
+		return true;
+	}
+
+	BufferBinding& findBuffer(GLenum target)
+	{
+		State& s = current();
+		for (int i = 0; i < s.numBuffers; i++)
+		{
+			if (s.buffers[i].target == target)
+			{
+				return s.buffers[i];
+			}
+		}
+		// more targets than expected are all tracked by the last entry, which then rarely filters anything
+		BufferBinding& binding = s.buffers[s.numBuffers < MAX_TARGETS ? s.numBuffers++ : MAX_TARGETS - 1];
+		binding = { target, 0, UNKNOWN, 0, 0 };
+		return binding;
+	}
+
+	BufferBinding& findIndexedBuffer(GLenum target, GLuint index)
+	{
+		State& s = current();
+		for (int i = 0; i < s.numIndexedBuffers; i++)
+		{
+			if (s.indexedBuffers[i].target == target && s.indexedBuffers[i].index == index)
+			{
+				return s.indexedBuffers[i];
+			}
+		}
+		BufferBinding& binding = s.indexedBuffers[s.numIndexedBuffers < MAX_TARGETS ? s.numIndexedBuffers++ : MAX_TARGETS - 1];
+		binding = { target, index, UNKNOWN, 0, 0 };
+		return binding;
+	}
+
+	Capability& findCapability(GLenum capability)
+	{
+		State& s = current();
+		for (int i = 0; i < s.numCapabilities; i++)
+		{
+			if (s.capabilities[i].capability == capability)
+			{
+				return s.capabilities[i];
+			}
+		}
+		Capability& entry = s.capabilities[s.numCapabilities < MAX_TARGETS ? s.numCapabilities++ : MAX_TARGETS - 1];
+		entry = { capability, -1 };
+		return entry;
+	}
+
+	bool sameRange(const BufferBinding& binding, GLuint buffer, GLintptr offset, GLsizeiptr size)
+	{
+		return binding.buffer == buffer && binding.offset == offset && binding.size == size;
+	}
+
+	void setCapability(GLenum capability, int enabled)
+	{
+		GLState::Category category = capability == GL_DEPTH_TEST ? GLState::DEPTH : GLState::RASTER;
+		if (change(category, findCapability(capability).enabled, enabled))
+		{
+			if (enabled)
+			{
+				glEnable(capability);
+			}
+			else
+			{
+				glDisable(capability);
+			}
+		}
+	}
+}
+
+void GLState::useProgram(GLuint program)
+{
+	if (change(PROGRAM, current().program, program))
+	{
+		glUseProgram(program);
+	}
+}
+
+void GLState::bindVertexArray(GLuint vertexArray)
+{
+	if (change(VERTEX_ARRAY, current().vertexArray, vertexArray))
+	{
+		glBindVertexArray(vertexArray);
+	}
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+	if (target == GL_ELEMENT_ARRAY_BUFFER)
+	{
+		numIssued[BUFFER]++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+	if (change(BUFFER, findBuffer(target).buffer, buffer))
+	{
+		glBindBuffer(target, buffer);
+	}
+}
+
+void GLState::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	// also binds the target itself
+	BufferBinding& binding = findIndexedBuffer(target, index);
+	if (filtering && sameRange(binding, buffer, 0, -1) && findBuffer(target).buffer == buffer)
+	{
+		numFiltered[BUFFER]++;
+		return;
+	}
+	binding.buffer = buffer;
+	binding.offset = 0;
+	binding.size = -1;
+	findBuffer(target).buffer = buffer;
+	numIssued[BUFFER]++;
+	glBindBufferBase(target, index, buffer);
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	BufferBinding& binding = findIndexedBuffer(target, index);
+	if (filtering && sameRange(binding, buffer, offset, size) && findBuffer(target).buffer == buffer)
+	{
+		numFiltered[BUFFER]++;
+		return;
+	}
+	binding.buffer = buffer;
+	binding.offset = offset;
+	binding.size = size;
+	findBuffer(target).buffer = buffer;
+	numIssued[BUFFER]++;
+	glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLState::activeTexture(GLenum unit)
+{
+	if (change(TEXTURE, current().activeUnit, unit))
+	{
+		glActiveTexture(unit);
+	}
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture)
+{
+	State& s = current();
+	int unit = s.activeUnit == UNKNOWN ? -1 : (int)(s.activeUnit - GL_TEXTURE0);
+	if (target != GL_TEXTURE_2D || unit < 0 || unit >= MAX_TEXTURE_UNITS)
+	{
+		numIssued[TEXTURE]++;
+		glBindTexture(target, texture);
+		return;
+	}
+	if (change(TEXTURE, s.textures[unit], texture))
+	{
+		glBindTexture(target, texture);
+	}
+}
+
+void GLState::enable(GLenum capability)
+{
+	setCapability(capability, 1);
+}
+
+void GLState::disable(GLenum capability)
+{
+	setCapability(capability, 0);
+}
+
+void GLState::frontFace(GLenum mode)
+{
+	if (change(RASTER, current().frontFace, mode))
+	{
+		glFrontFace(mode);
+	}
+}
+
+void GLState::cullFace(GLenum mode)
+{
+	if (change(RASTER, current().cullFace, mode))
+	{
+		glCullFace(mode);
+	}
+}
+
+void GLState::colorMask(GLboolean enable)
+{
+	if (change(RASTER, current().colorMask, (GLuint)enable))
+	{
+		glColorMask(enable, enable, enable, enable);
+	}
+}
+
+void GLState::depthFunc(GLenum func)
+{
+	if (change(DEPTH, current().depthFunc, func))
+	{
+		glDepthFunc(func);
+	}
+}
+
+void GLState::depthMask(GLboolean enable)
+{
+	if (change(DEPTH, current().depthMask, (GLuint)enable))
+	{
+		glDepthMask(enable);
+	}
+}
+
+void GLState::deleteBuffers(GLsizei count, const GLuint* buffers)
+{
+	State& s = current();
+	for (GLsizei i = 0; i < count; i++)
+	{
+		for (int b = 0; b < s.numBuffers; b++)
+		{
+			s.buffers[b].buffer = s.buffers[b].buffer == buffers[i] ? 0 : s.buffers[b].buffer;
+		}
+		for (int b = 0; b < s.numIndexedBuffers; b++)
+		{
+			if (s.indexedBuffers[b].buffer == buffers[i])
+			{
+				s.indexedBuffers[b] = { s.indexedBuffers[b].target, s.indexedBuffers[b].index, 0, 0, -1 };
+			}
+		}
+	}
+	glDeleteBuffers(count, buffers);
+}
+
+void GLState::deleteTextures(GLsizei count, const GLuint* textures)
+{
+	State& s = current();
+	for (GLsizei i = 0; i < count; i++)
+	{
+		for (GLuint& texture : s.textures)
+		{
+			texture = texture == textures[i] ? 0 : texture;
+		}
+	}
+	glDeleteTextures(count, textures);
+}
+
+void GLState::deleteVertexArrays(GLsizei count, const GLuint* vertexArrays)
+{
+	State& s = current();
+	for (GLsizei i = 0; i < count; i++)
+	{
+		s.vertexArray = s.vertexArray == vertexArrays[i] ? 0 : s.vertexArray;
+	}
+	glDeleteVertexArrays(count, vertexArrays);
+}
+
+void GLState::invalidate()
+{
+	state.program = UNKNOWN;
+	state.vertexArray = UNKNOWN;
+	state.numBuffers = 0;
+	state.numIndexedBuffers = 0;
+	state.activeUnit = UNKNOWN;
+	for (GLuint& texture : state.textures)
+	{
+		texture = UNKNOWN;
+	}
+	state.numCapabilities = 0;
+	state.frontFace = UNKNOWN;
+	state.cullFace = UNKNOWN;
+	state.colorMask = UNKNOWN;
+	state.depthFunc = UNKNOWN;
+	state.depthMask = UNKNOWN;
+	stateValid = true;
+}
+
+void GLState::setFiltering(bool enable)
+{
+	filtering = enable;
+}
+
+bool GLState::isFiltering()
+{
+	return filtering;
+}
+
+int GLState::getNumIssued(Category category)
+{
+	return numIssued[category];
+}
+
+int GLState::getNumFiltered(Category category)
+{
+	return numFiltered[category];
+}
+
+const char* GLState::getIssuedName(Category category)
+{
+	return issuedNames[category];
+}
+
+const char* GLState::getFilteredName(Category category)
+{
+	return filteredNames[category];
+}
+
+void GLState::resetCounters()
+{
+	for (int category = 0; category < NUM_CATEGORIES; category++)
+	{
+		numIssued[category] = 0;
+		numFiltered[category] = 0;
+	}
+}
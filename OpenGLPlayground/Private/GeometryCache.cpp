@@ -0,0 +1,176 @@
+#include <iostream>
+#include <tuple>
+#include "GLState.h"
+#include "Sphere.h"
+#include "Torus.h"
+#include "GeometryCache.h"
+
+bool GeometryKey::operator<(const GeometryKey& other) const
+{
+	return std::tie(type, format, precision, params[0], params[1])
+		< std::tie(other.type, other.format, other.precision, other.params[0], other.params[1]);
+}
+
+GeometryCache::GeometryCache()
+	: hits{ 0 }
+	, misses{ 0 }
+	, residentBytes{ 0 }
+{
+}
+
+Mesh GeometryCache::acquireSphere(MeshArena& arena, int numSlices)
+{
+	GeometryKey key{ GeometryType::Sphere, VertexFormat::PosTexNorm, numSlices, { 0.0f, 0.0f } };
+	Mesh mesh;
+	if (findInArena(key, mesh))
+	{
+		return mesh;
+	}
+
+	Sphere sphere(numSlices);
+	return insert(arena, key, sphere.getVertices(), sphere.getTexCoords(), sphere.getNormals(), sphere.getStripIndices(), sphere.getIndices());
+}
+
+Mesh GeometryCache::acquireTorus(MeshArena& arena, float innerRadius, float outerRadius, int numRings)
+{
+	GeometryKey key{ GeometryType::Torus, VertexFormat::PosTexNorm, numRings, { innerRadius, outerRadius } };
+	Mesh mesh;
+	if (findInArena(key, mesh))
+	{
+		return mesh;
+	}
+
+	Torus torus(innerRadius, outerRadius, numRings);
+	return insert(arena, key, torus.getVertices(), torus.getTexCoords(), torus.getNormals(), torus.getStripIndices(), torus.getIndices());
+}
+
+GeometryRange GeometryCache::createSphere(int numSlices, VertexFormat format)
+{
+	Sphere sphere(numSlices);
+	return upload(format, sphere.getVertices(), sphere.getTexCoords(), sphere.getNormals(), sphere.getStripIndices(), sphere.getIndices());
+}
+
+GeometryRange GeometryCache::createTorus(float innerRadius, float outerRadius, int numRings, VertexFormat format)
+{
+	Torus torus(innerRadius, outerRadius, numRings);
+	return upload(format, torus.getVertices(), torus.getTexCoords(), torus.getNormals(), torus.getStripIndices(), torus.getIndices());
+}
+
+void GeometryCache::release(const Mesh& mesh)
+{
+	// sub-allocations never overlap, so the first index tells the arena's shapes apart
+	GLuint firstIndex = mesh.getIndirectCommand(1, 0).firstIndex;
+	for (auto it = arenaEntries.begin(); it != arenaEntries.end(); ++it)
+	{
+		if (it->second.mesh.getVao() == mesh.getVao() && it->second.mesh.getIndirectCommand(1, 0).firstIndex == firstIndex)
+		{
+			if (--it->second.refCount == 0)
+			{
+				residentBytes -= it->second.bytes;
+				arenaEntries.erase(it);
+			}
+			return;
+		}
+	}
+}
+
+void GeometryCache::printStats()
+{
+	std::cout << "geometry cache: " << getNumEntries() << " shapes in the mesh arena, " << residentBytes << " bytes resident, "
+		<< hits << " hits / " << misses << " misses (" << getHitRate() * 100.0f << "% hit rate)" << std::endl;
+}
+
+bool GeometryCache::findInArena(const GeometryKey& key, Mesh& mesh)
+{
+	auto it = arenaEntries.find(key);
+	if (it == arenaEntries.end())
+	{
+		misses++;
+		return false;
+	}
+	hits++;
+	it->second.refCount++;
+	mesh = it->second.mesh;
+	return true;
+}
+
+Mesh GeometryCache::insert(MeshArena& arena, const GeometryKey& key, const std::vector<glm::vec3>& vertices, const std::vector<glm::vec2>& texCoords,
+	const std::vector<glm::vec3>& normals, const std::vector<unsigned int>& stripIdxs, const std::vector<int>& listIdxs)
+{
+	std::vector<ArenaVertex> arenaVertices(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		arenaVertices[i] = { vertices[i], texCoords[i], normals[i] };
+	}
+
+	// the arena's indices are always 32-bit, the strip's restart markers are already the 32-bit fixed index
+	bool useStrip = !stripIdxs.empty() && stripIdxs.size() < listIdxs.size();
+	std::vector<GLuint> indices = useStrip ? std::vector<GLuint>(stripIdxs.begin(), stripIdxs.end())
+		: std::vector<GLuint>(listIdxs.begin(), listIdxs.end());
+	ArenaShape shape;
+	shape.mesh = arena.add(arenaVertices, indices, useStrip ? GL_TRIANGLE_STRIP : GL_TRIANGLES);
+	shape.refCount = 1;
+	shape.bytes = arenaVertices.size() * sizeof(ArenaVertex) + indices.size() * sizeof(GLuint);
+	residentBytes += shape.bytes;
+	arenaEntries[key] = shape;
+	return shape.mesh;
+}
+
+GeometryRange GeometryCache::upload(VertexFormat format, const std::vector<glm::vec3>& vertices, const std::vector<glm::vec2>& texCoords,
+	const std::vector<glm::vec3>& normals, const std::vector<unsigned int>& stripIdxs, const std::vector<int>& listIdxs)
+{
+	GeometryRange range;
+	range.format = format;
+	range.numVertices = (int)vertices.size();
+
+	// interleave the attributes the format asks for
+	std::vector<float> vertexVals;
+	for (int i = 0; i < range.numVertices; i++)
+	{
+		vertexVals.push_back(vertices[i].x);
+		vertexVals.push_back(vertices[i].y);
+		vertexVals.push_back(vertices[i].z);
+		if (format == VertexFormat::PosTexNorm)
+		{
+			vertexVals.push_back(texCoords[i].s);
+			vertexVals.push_back(texCoords[i].t);
+			vertexVals.push_back(normals[i].x);
+			vertexVals.push_back(normals[i].y);
+			vertexVals.push_back(normals[i].z);
+		}
+	}
+	range.vertexStride = (GLsizei)(vertexVals.size() * sizeof(float) / range.numVertices);
+
+	// prefer the strip when it is shorter, and 16-bit indices when every vertex fits below the restart index
+	bool useStrip = !stripIdxs.empty() && stripIdxs.size() < listIdxs.size();
+	range.mode = useStrip ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+	range.numIndices = (GLsizei)(useStrip ? stripIdxs.size() : listIdxs.size());
+	range.indexType = range.numVertices < 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	GLsizeiptr indexSize = range.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+	std::vector<unsigned char> indexBytes(range.numIndices * indexSize);
+	for (int i = 0; i < range.numIndices; i++)
+	{
+		GLuint index = useStrip ? stripIdxs[i] : (GLuint)listIdxs[i];
+		if (range.indexType == GL_UNSIGNED_SHORT)
+		{
+			((GLushort*)&indexBytes[0])[i] = (GLushort)index; // truncating keeps the fixed restart index valid, 0xFFFFFFFF becomes 0xFFFF
+		}
+		else
+		{
+			((GLuint*)&indexBytes[0])[i] = index;
+		}
+	}
+
+	// vertices and indices share one buffer, the indices start at the next 4-byte boundary
+	GLsizeiptr vertexBytes = vertexVals.size() * sizeof(float);
+	range.indexOffset = (vertexBytes + 3) & ~(GLsizeiptr)3;
+	range.bytes = range.indexOffset + indexBytes.size();
+
+	glGenBuffers(1, &range.buffer);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, range.buffer);
+	glBufferData(GL_ARRAY_BUFFER, range.bytes, NULL, GL_STATIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, vertexBytes, &vertexVals[0]);
+	glBufferSubData(GL_ARRAY_BUFFER, range.indexOffset, indexBytes.size(), &indexBytes[0]);
+	return range;
+}
@@ -0,0 +1,251 @@
+#include "GpuCuller.h"
+#include <cmath>
+#include <iostream>
+#include <glm/gtc/type_ptr.hpp>
+#include "GLState.h"
+#include "UniformBlocks.h"
+#include "Utils.h"
+
+#ifndef GL_PARAMETER_BUFFER
+#define GL_PARAMETER_BUFFER 0x80EE
+#endif
+
+constexpr GLuint WORKGROUP_SIZE = 64; // local_size_x of the cull shader
+
+// storage bindings of the cull shader
+constexpr GLuint OBJECTS_BINDING = 0;
+constexpr GLuint MESHES_BINDING = 1;
+constexpr GLuint VISIBLE_BINDING = 2;
+constexpr GLuint COMMANDS_BINDING = 3;
+constexpr GLuint COUNTER_BINDING = 4;
+constexpr GLuint RETEST_BINDING = 5;
+constexpr GLuint RETEST_COUNTER_BINDING = 6;
+constexpr GLuint HIZ_UNIT = 2;
+
+// mirrors CullMesh, the draw command fields that depend on the mesh
+struct CullMesh
+{
+	GLuint count;
+	GLuint firstIndex;
+	GLint baseVertex;
+};
+
+GpuCuller::GpuCuller()
+	: arena{ nullptr }
+	, multiDrawCount{ nullptr }
+	, objectBuffer{ 0 }
+	, meshBuffer{ 0 }
+	, retestBuffer{ 0 }
+	, retestCounter{ 0 }
+	, numObjects{ 0 }
+	, phaseLoc{ -1 }
+	, numObjectsLoc{ -1 }
+	, planesLoc{ -1 }
+	, shadowMatrixLoc{ -1 }
+	, litPassLoc{ -1 }
+	, viewProjectionLoc{ -1 }
+	, hiZValidLoc{ -1 }
+	, hiZSizeLoc{ -1 }
+	, hiZLevelsLoc{ -1 }
+{
+}
+
+void GpuCuller::init(MeshArena* meshArena, int numPasses)
+{
+	arena = meshArena;
+	program.createCompute((Utils::getResourcePath() + "objectCullShader.glsl").c_str());
+	phaseLoc = program.uniform("phase");
+	numObjectsLoc = program.uniform("numObjects");
+	planesLoc = program.uniform("frustumPlanes");
+	shadowMatrixLoc = program.uniform("shadowMatrix");
+	litPassLoc = program.uniform("litPass");
+	viewProjectionLoc = program.uniform("viewProjection");
+	hiZValidLoc = program.uniform("hiZValid");
+	hiZSizeLoc = program.uniform("hiZSize");
+	hiZLevelsLoc = program.uniform("hiZLevels");
+
+	// without the count read from a buffer, every command slot is drawn and the unused ones are cleared to nothing
+	multiDrawCount = (MultiDrawElementsIndirectCountProc)Utils::loadGLFunction("glMultiDrawElementsIndirectCount", 4, 6, "GL_ARB_indirect_parameters");
+	if (multiDrawCount == nullptr)
+	{
+		multiDrawCount = (MultiDrawElementsIndirectCountProc)Utils::loadGLFunction("glMultiDrawElementsIndirectCountARB", 4, 6, "GL_ARB_indirect_parameters");
+	}
+	std::cout << "gpu culling: draw count " << (multiDrawCount != nullptr ? "read from the counter" : "fixed, unused commands cleared") << std::endl;
+
+	glGenBuffers(1, &objectBuffer);
+	glGenBuffers(1, &meshBuffer);
+	glGenBuffers(1, &retestBuffer);
+	glGenBuffers(1, &retestCounter);
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, retestCounter);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+	passes.resize(numPasses + 1);
+	for (PassBuffers& buffers : passes)
+	{
+		glGenBuffers(1, &buffers.visible);
+		glGenBuffers(1, &buffers.commands);
+		glGenBuffers(1, &buffers.counter);
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.counter);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+	}
+}
+
+void GpuCuller::setMeshes(const std::vector<const Mesh*>& meshes)
+{
+	std::vector<CullMesh> table;
+	meshBounds.clear();
+	for (const Mesh* mesh : meshes)
+	{
+		DrawElementsIndirectCommand command = mesh->getIndirectCommand(1, 0);
+		table.push_back({ command.count, command.firstIndex, command.baseVertex });
+		meshBounds.push_back(mesh->getBounds());
+	}
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, meshBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, table.size() * sizeof(CullMesh), &table[0], GL_STATIC_DRAW);
+}
+
+void GpuCuller::setObjects(std::vector<GpuObject>& objects)
+{
+	numObjects = (int)objects.size();
+	if (numObjects == 0)
+	{
+		return;
+	}
+
+	for (GpuObject& object : objects)
+	{
+		const glm::vec4& bounds = meshBounds[object.mesh];
+		glm::vec3 squaredScales(glm::dot(object.world[0], object.world[0]), glm::dot(object.world[1], object.world[1]), glm::dot(object.world[2], object.world[2]));
+		float scale = sqrtf(glm::max(squaredScales.x, glm::max(squaredScales.y, squaredScales.z)));
+		object.sphere = glm::vec4(glm::vec3(object.world * glm::vec4(glm::vec3(bounds), 1.0f)), bounds.w * scale);
+	}
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, objectBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(GpuObject), &objects[0], GL_STATIC_DRAW);
+
+	// room for every object to survive
+	for (PassBuffers& buffers : passes)
+	{
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.visible);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, numObjects * sizeof(ObjectData), NULL, GL_DYNAMIC_COPY);
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers.commands);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, numObjects * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+	}
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, retestBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, numObjects * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+	arena->reserveDraws(numObjects);
+}
+
+void GpuCuller::cull(int pass, const Frustum& frustum, const glm::mat4& shadowMatrix, bool litPass)
+{
+	if (numObjects == 0)
+	{
+		return;
+	}
+	clear(passes[pass].counter);
+	dispatch(FRUSTUM_ONLY, passes[pass], frustum, shadowMatrix, litPass, glm::mat4(1.0f), nullptr);
+}
+
+void GpuCuller::cullEarly(int pass, const Frustum& frustum, const glm::mat4& viewProjection, const glm::mat4& shadowMatrix, const HiZPyramid& hiZ)
+{
+	if (numObjects == 0)
+	{
+		return;
+	}
+	clear(passes[pass].counter);
+	clear(retestCounter);
+	dispatch(EARLY, passes[pass], frustum, shadowMatrix, true, viewProjection, &hiZ);
+}
+
+void GpuCuller::cullLate(const glm::mat4& viewProjection, const glm::mat4& shadowMatrix, const HiZPyramid& hiZ)
+{
+	if (numObjects == 0)
+	{
+		return;
+	}
+	// the frustum was tested in the early phase, only its rejects are read
+	clear(passes.back().counter);
+	dispatch(LATE, passes.back(), Frustum(), shadowMatrix, true, viewProjection, &hiZ);
+}
+
+void GpuCuller::draw(int pass, GLuint objectStorageBinding)
+{
+	if (numObjects == 0)
+	{
+		return;
+	}
+	drawBuffers(passes[pass], objectStorageBinding);
+}
+
+void GpuCuller::drawLate(GLuint objectStorageBinding)
+{
+	if (numObjects == 0)
+	{
+		return;
+	}
+	drawBuffers(passes.back(), objectStorageBinding);
+}
+
+void GpuCuller::clear(GLuint buffer)
+{
+	// cleared on the GPU, nothing is read back
+	GLuint zero = 0;
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+}
+
+void GpuCuller::dispatch(Phase phase, PassBuffers& buffers, const Frustum& frustum, const glm::mat4& shadowMatrix, bool litPass,
+	const glm::mat4& viewProjection, const HiZPyramid* hiZ)
+{
+	if (multiDrawCount == nullptr)
+	{
+		clear(buffers.commands);
+	}
+
+	GLState::useProgram(program.getId());
+	glUniform1i(phaseLoc, phase);
+	glUniform1ui(numObjectsLoc, (GLuint)numObjects);
+	glUniform4fv(planesLoc, 6, glm::value_ptr(frustum.planes[0]));
+	glUniformMatrix4fv(shadowMatrixLoc, 1, GL_FALSE, glm::value_ptr(shadowMatrix));
+	glUniform1i(litPassLoc, litPass ? 1 : 0);
+	if (hiZ != nullptr)
+	{
+		glUniformMatrix4fv(viewProjectionLoc, 1, GL_FALSE, glm::value_ptr(viewProjection));
+		glUniform1i(hiZValidLoc, hiZ->isBuilt() ? 1 : 0);
+		glUniform2i(hiZSizeLoc, hiZ->getWidth(), hiZ->getHeight());
+		glUniform1i(hiZLevelsLoc, hiZ->getNumLevels());
+		GLState::activeTexture(GL_TEXTURE0 + HIZ_UNIT);
+		GLState::bindTexture(GL_TEXTURE_2D, hiZ->getTexture());
+		GLState::activeTexture(GL_TEXTURE0);
+	}
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECTS_BINDING, objectBuffer);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, MESHES_BINDING, meshBuffer);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_BINDING, buffers.visible);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, buffers.commands);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, COUNTER_BINDING, buffers.counter);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, RETEST_BINDING, retestBuffer);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, RETEST_COUNTER_BINDING, retestCounter);
+
+	// the late phase reads at most numObjects retest entries, the count itself stays on the GPU
+	glDispatchCompute((numObjects + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+	// the commands and count are read as indirect parameters, the object data by the vertex shader,
+	// and the retest list by the late phase
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GpuCuller::drawBuffers(PassBuffers& buffers, GLuint objectStorageBinding)
+{
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, objectStorageBinding, buffers.visible);
+	GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, buffers.commands);
+	if (multiDrawCount != nullptr)
+	{
+		GLState::bindBuffer(GL_PARAMETER_BUFFER, buffers.counter);
+		multiDrawCount(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, 0, numObjects, 0);
+
+		// left bound, a zero count would also cap the plain multi-draws of other passes on some drivers
+		GLState::bindBuffer(GL_PARAMETER_BUFFER, 0);
+	}
+	else
+	{
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, numObjects, 0);
+	}
+}
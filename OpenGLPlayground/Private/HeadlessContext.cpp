@@ -0,0 +1,129 @@
+#include "HeadlessContext.h"
+#include <iostream>
+
+#if defined(__linux__)
+#define HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+HeadlessContext::HeadlessContext()
+	: display{ nullptr }
+	, context{ nullptr }
+	, platformName{ "none" }
+{
+}
+
+#ifdef HEADLESS_EGL
+
+bool HeadlessContext::create()
+{
+	auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	auto queryDevices = (PFNEGLQUERYDEVICESEXTPROC)eglGetProcAddress("eglQueryDevicesEXT");
+	if (getPlatformDisplay == nullptr)
+	{
+		std::cout << "headless context: EGL has no platform displays" << std::endl;
+		return false;
+	}
+
+	// devices come in the driver's order, which puts hardware before Mesa's software device
+	if (queryDevices != nullptr)
+	{
+		EGLDeviceEXT devices[8];
+		EGLint numDevices = 0;
+		queryDevices(8, devices, &numDevices);
+		for (int i = 0; i < numDevices; i++)
+		{
+			if (createOn(getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, devices[i], nullptr), "EGL device"))
+			{
+				return true;
+			}
+		}
+	}
+	if (createOn(getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr), "EGL surfaceless"))
+	{
+		return true;
+	}
+	std::cout << "headless context: no EGL display gives an OpenGL 4.3 core context" << std::endl;
+	return false;
+}
+
+bool HeadlessContext::createOn(void* candidate, const char* name)
+{
+	EGLDisplay eglDisplay = (EGLDisplay)candidate;
+	EGLint major, minor;
+	if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, &major, &minor))
+	{
+		return false;
+	}
+
+	// the config only matters for the context, every pass draws into framebuffer objects
+	const EGLint configAttributes[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE };
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	EGLContext eglContext = EGL_NO_CONTEXT;
+	if (eglBindAPI(EGL_OPENGL_API) && eglChooseConfig(eglDisplay, configAttributes, &config, 1, &numConfigs) && numConfigs > 0)
+	{
+		eglContext = eglCreateContext(eglDisplay, config, EGL_NO_CONTEXT, contextAttributes);
+	}
+	if (eglContext == EGL_NO_CONTEXT || !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext))
+	{
+		if (eglContext != EGL_NO_CONTEXT)
+		{
+			eglDestroyContext(eglDisplay, eglContext);
+		}
+		eglTerminate(eglDisplay);
+		return false;
+	}
+
+	display = eglDisplay;
+	context = eglContext;
+	platformName = name;
+	return true;
+}
+
+void HeadlessContext::destroy()
+{
+	if (context != nullptr)
+	{
+		eglMakeCurrent((EGLDisplay)display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext((EGLDisplay)display, (EGLContext)context);
+		eglTerminate((EGLDisplay)display);
+	}
+	display = nullptr;
+	context = nullptr;
+}
+
+void* HeadlessContext::getProcAddress(const char* name)
+{
+	return (void*)eglGetProcAddress(name);
+}
+
+#else
+
+bool HeadlessContext::create()
+{
+	std::cout << "headless context: this build has no EGL" << std::endl;
+	return false;
+}
+
+bool HeadlessContext::createOn(void* candidate, const char* name)
+{
+	return false;
+}
+
+void HeadlessContext::destroy()
+{
+}
+
+void* HeadlessContext::getProcAddress(const char* name)
+{
+	return nullptr;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#include "HiZPyramid.h"
+#include <algorithm>
+#include "GLState.h"
+#include "Utils.h"
+
+constexpr int WORKGROUP_SIZE = 8; // local_size_x and local_size_y of the reduction shader
+
+HiZPyramid::HiZPyramid()
+	: depthCopy{ 0 }
+	, pyramid{ 0 }
+	, width{ 0 }
+	, height{ 0 }
+	, numLevels{ 0 }
+	, built{ false }
+	, srcLevelLoc{ -1 }
+	, srcSizeLoc{ -1 }
+	, dstSizeLoc{ -1 }
+{
+}
+
+void HiZPyramid::init(int pyramidWidth, int pyramidHeight)
+{
+	program.createCompute((Utils::getResourcePath() + "hiZReduceShader.glsl").c_str());
+	srcLevelLoc = program.uniform("srcLevel");
+	srcSizeLoc = program.uniform("srcSize");
+	dstSizeLoc = program.uniform("dstSize");
+	resize(pyramidWidth, pyramidHeight);
+}
+
+void HiZPyramid::resize(int pyramidWidth, int pyramidHeight)
+{
+	width = pyramidWidth;
+	height = pyramidHeight;
+	numLevels = 1;
+	while ((std::max(width, height) >> numLevels) > 0)
+	{
+		numLevels++;
+	}
+	built = false;
+
+	// immutable storage cannot be resized, start over with new names
+	GLState::deleteTextures(1, &depthCopy);
+	GLState::deleteTextures(1, &pyramid);
+	glGenTextures(1, &depthCopy);
+	GLState::bindTexture(GL_TEXTURE_2D, depthCopy);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &pyramid);
+	GLState::bindTexture(GL_TEXTURE_2D, pyramid);
+	glTexStorage2D(GL_TEXTURE_2D, numLevels, GL_R32F, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+}
+
+void HiZPyramid::build()
+{
+	GLState::bindTexture(GL_TEXTURE_2D, depthCopy);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, width, height);
+
+	GLState::useProgram(program.getId());
+	GLState::activeTexture(GL_TEXTURE0);
+	int srcWidth = width;
+	int srcHeight = height;
+	for (int level = 0; level < numLevels; level++)
+	{
+		int dstWidth = std::max(width >> level, 1);
+		int dstHeight = std::max(height >> level, 1);
+
+		// level 0 copies the depth, every other level reads the one below it
+		GLState::bindTexture(GL_TEXTURE_2D, level == 0 ? depthCopy : pyramid);
+		glUniform1i(srcLevelLoc, level == 0 ? 0 : level - 1);
+		glUniform2i(srcSizeLoc, srcWidth, srcHeight);
+		glUniform2i(dstSizeLoc, dstWidth, dstHeight);
+		glBindImageTexture(0, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((dstWidth + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, (dstHeight + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1);
+
+		// the next level fetches this one
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		srcWidth = dstWidth;
+		srcHeight = dstHeight;
+	}
+	GLState::bindTexture(GL_TEXTURE_2D, 0);
+	built = true;
+}
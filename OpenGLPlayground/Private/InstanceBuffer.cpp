@@ -0,0 +1,50 @@
+#include "InstanceBuffer.h"
+#include "GLState.h"
+
+InstanceBuffer::InstanceBuffer()
+	: buffer{ 0 }
+	, capacity{ 0 }
+	, count{ 0 }
+{
+}
+
+void InstanceBuffer::upload(const std::vector<InstanceData>& instances)
+{
+	if (buffer == 0)
+	{
+		glGenBuffers(1, &buffer);
+	}
+	count = (int)instances.size();
+	GLsizeiptr bytes = instances.size() * sizeof(InstanceData);
+	if (bytes == 0)
+	{
+		return;
+	}
+
+	GLState::bindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (bytes > capacity)
+	{
+		glBufferData(GL_ARRAY_BUFFER, bytes, &instances[0], GL_STATIC_DRAW);
+		capacity = bytes;
+	}
+	else
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, &instances[0]);
+	}
+}
+
+void InstanceBuffer::attach(Mesh& mesh, GLuint bindingIndex)
+{
+	// the name has to exist before the vertex array records it
+	if (buffer == 0)
+	{
+		glGenBuffers(1, &buffer);
+	}
+	mesh.setVertexBuffer(bindingIndex, buffer, 0, sizeof(InstanceData));
+	mesh.setBindingDivisor(bindingIndex, 1);
+	for (int column = 0; column < 4; column++)
+	{
+		mesh.setAttribute(INSTANCE_MATRIX_LOCATION + column, 4, bindingIndex, column * sizeof(glm::vec4));
+	}
+	mesh.setAttribute(INSTANCE_COLOR_LOCATION, 4, bindingIndex, sizeof(glm::mat4));
+}
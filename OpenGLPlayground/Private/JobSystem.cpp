@@ -0,0 +1,147 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+JobSystem::JobSystem()
+	: pending{ 0 }
+	, stopping{ false }
+{
+	queues.emplace_back(new WorkQueue());
+}
+
+JobSystem::~JobSystem()
+{
+	stop();
+}
+
+void JobSystem::start(int numThreads)
+{
+	stop();
+	numThreads = std::max(numThreads, 1);
+	stopping = false;
+	queues.clear();
+	for (int i = 0; i < numThreads; i++)
+	{
+		queues.emplace_back(new WorkQueue());
+	}
+	for (int i = 1; i < numThreads; i++)
+	{
+		workers.emplace_back(&JobSystem::workerLoop, this, i);
+	}
+}
+
+void JobSystem::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	workers.clear();
+}
+
+void JobSystem::parallelFor(int count, int batchSize, const std::function<void(int, int)>& body)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	batchSize = std::max(batchSize, 1);
+	int numBatches = (count + batchSize - 1) / batchSize;
+	if (numBatches == 1 || workers.empty())
+	{
+		// still batch by batch, callers may size buffers by batchSize
+		for (int begin = 0; begin < count; begin += batchSize)
+		{
+			body(begin, std::min(begin + batchSize, count));
+		}
+		return;
+	}
+
+	// contiguous runs of batches per queue, so each thread starts on memory no other thread writes
+	std::atomic<int> remaining{ numBatches };
+	int numQueues = (int)queues.size();
+	for (int q = 0; q < numQueues; q++)
+	{
+		int firstBatch = numBatches * q / numQueues;
+		int lastBatch = numBatches * (q + 1) / numQueues;
+		std::lock_guard<std::mutex> lock(queues[q]->mutex);
+		// pushed back to front, the owner pops from the back and so walks its run in order
+		for (int batch = lastBatch - 1; batch >= firstBatch; batch--)
+		{
+			int begin = batch * batchSize;
+			queues[q]->jobs.push_back({ &body, begin, std::min(begin + batchSize, count), &remaining });
+		}
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		pending += numBatches;
+	}
+	wake.notify_all();
+
+	while (remaining.load() > 0)
+	{
+		if (!runOne(0))
+		{
+			std::this_thread::yield(); // the last batches are running on other threads
+		}
+	}
+}
+
+bool JobSystem::runOne(int queue)
+{
+	Job job{};
+	bool found = false;
+	{
+		WorkQueue& own = *queues[queue];
+		std::lock_guard<std::mutex> lock(own.mutex);
+		if (!own.jobs.empty())
+		{
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			found = true;
+		}
+	}
+	// steal from the front, the end the owner reaches last
+	int numQueues = (int)queues.size();
+	for (int i = 1; i < numQueues && !found; i++)
+	{
+		WorkQueue& victim = *queues[(queue + i) % numQueues];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.jobs.empty())
+		{
+			job = victim.jobs.front();
+			victim.jobs.pop_front();
+			found = true;
+		}
+	}
+	if (!found)
+	{
+		return false;
+	}
+
+	pending--;
+	(*job.body)(job.begin, job.end);
+	job.remaining->fetch_sub(1);
+	return true;
+}
+
+void JobSystem::workerLoop(int queue)
+{
+	for (;;)
+	{
+		if (runOne(queue))
+		{
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this] { return stopping || pending.load() > 0; });
+		if (stopping)
+		{
+			return;
+		}
+	}
+}
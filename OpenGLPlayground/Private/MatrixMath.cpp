@@ -0,0 +1,227 @@
+#include "MatrixMath.h"
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define MATRIX_MATH_SSE
+#endif
+
+namespace
+{
+	// relative to the squared scale, loose enough for matrices built from sines and cosines in single precision
+	constexpr float UNIFORM_TOLERANCE = 1e-4f;
+
+#ifdef MATRIX_MATH_SSE
+	// a * b, one column of the result is a sum of a's columns weighted by a column of b
+	inline void multiplySSE(const float* a, const float* b, float* out)
+	{
+		__m128 a0 = _mm_loadu_ps(a);
+		__m128 a1 = _mm_loadu_ps(a + 4);
+		__m128 a2 = _mm_loadu_ps(a + 8);
+		__m128 a3 = _mm_loadu_ps(a + 12);
+		for (int c = 0; c < 4; c++)
+		{
+			const float* column = b + c * 4;
+			__m128 sum = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(column[0])), _mm_mul_ps(a1, _mm_set1_ps(column[1]))),
+				_mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(column[2])), _mm_mul_ps(a3, _mm_set1_ps(column[3]))));
+			_mm_storeu_ps(out + c * 4, sum);
+		}
+	}
+
+	inline __m128 dot3(const __m128* a, const __m128* b)
+	{
+		return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+	}
+
+	inline void cross3(const __m128* a, const __m128* b, __m128* out)
+	{
+		out[0] = _mm_sub_ps(_mm_mul_ps(a[1], b[2]), _mm_mul_ps(a[2], b[1]));
+		out[1] = _mm_sub_ps(_mm_mul_ps(a[2], b[0]), _mm_mul_ps(a[0], b[2]));
+		out[2] = _mm_sub_ps(_mm_mul_ps(a[0], b[1]), _mm_mul_ps(a[1], b[0]));
+	}
+
+	inline __m128 absolute(__m128 v)
+	{
+		return _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+	}
+#endif
+
+	// columns i of the inverse transpose of the upper 3x3, with the translation's part in the last row
+	glm::mat4 normalFromColumns(const glm::vec3& n0, const glm::vec3& n1, const glm::vec3& n2, const glm::vec3& translation)
+	{
+		return glm::mat4(
+			glm::vec4(n0, -glm::dot(n0, translation)),
+			glm::vec4(n1, -glm::dot(n1, translation)),
+			glm::vec4(n2, -glm::dot(n2, translation)),
+			glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	}
+}
+
+glm::mat4 MatrixMath::multiply(const glm::mat4& a, const glm::mat4& b)
+{
+#ifdef MATRIX_MATH_SSE
+	glm::mat4 out;
+	multiplySSE(&a[0][0], &b[0][0], &out[0][0]);
+	return out;
+#else
+	return a * b;
+#endif
+}
+
+void MatrixMath::multiplyBatch(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+#ifdef MATRIX_MATH_SSE
+		multiplySSE(&a[0][0], &b[i][0][0], &out[i][0][0]);
+#else
+		out[i] = a * b[i];
+#endif
+	}
+}
+
+void MatrixMath::multiplyBatch(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+#ifdef MATRIX_MATH_SSE
+		multiplySSE(&a[i][0][0], &b[i][0][0], &out[i][0][0]);
+#else
+		out[i] = a[i] * b[i];
+#endif
+	}
+}
+
+glm::mat4 MatrixMath::composeTRS(const glm::vec3& translation, float angle, const glm::vec3& axis, const glm::vec3& scaling)
+{
+	// the rotation part of glm::rotate, each column then scaled by its axis' factor
+	float c = cosf(angle);
+	float s = sinf(angle);
+	glm::vec3 n = glm::normalize(axis);
+	glm::vec3 t = (1.0f - c) * n;
+
+	glm::mat4 out;
+	out[0] = glm::vec4(scaling.x * (t.x * n.x + c), scaling.x * (t.x * n.y + s * n.z), scaling.x * (t.x * n.z - s * n.y), 0.0f);
+	out[1] = glm::vec4(scaling.y * (t.y * n.x - s * n.z), scaling.y * (t.y * n.y + c), scaling.y * (t.y * n.z + s * n.x), 0.0f);
+	out[2] = glm::vec4(scaling.z * (t.z * n.x + s * n.y), scaling.z * (t.z * n.y - s * n.x), scaling.z * (t.z * n.z + c), 0.0f);
+	out[3] = glm::vec4(translation, 1.0f);
+	return out;
+}
+
+glm::mat4 MatrixMath::affineInverse(const glm::mat4& m)
+{
+	// the inverse of the upper 3x3 is the transpose of the normal matrix's
+	glm::mat4 normal = normalMatrix(m);
+	glm::mat3 inverse = glm::transpose(glm::mat3(normal));
+	glm::mat4 out(inverse);
+	out[3] = glm::vec4(-(inverse * glm::vec3(m[3])), 1.0f);
+	return out;
+}
+
+bool MatrixMath::isUniformScaleRotation(const glm::mat4& m, float& squaredScale)
+{
+	glm::vec3 a0(m[0]), a1(m[1]), a2(m[2]);
+	squaredScale = glm::dot(a0, a0);
+	float tolerance = UNIFORM_TOLERANCE * squaredScale;
+	return squaredScale > 0.0f
+		&& fabsf(glm::dot(a1, a1) - squaredScale) <= tolerance
+		&& fabsf(glm::dot(a2, a2) - squaredScale) <= tolerance
+		&& fabsf(glm::dot(a0, a1)) <= tolerance
+		&& fabsf(glm::dot(a0, a2)) <= tolerance
+		&& fabsf(glm::dot(a1, a2)) <= tolerance;
+}
+
+glm::mat4 MatrixMath::normalMatrix(const glm::mat4& m)
+{
+	glm::vec3 a0(m[0]), a1(m[1]), a2(m[2]);
+	float squaredScale;
+	if (isUniformScaleRotation(m, squaredScale))
+	{
+		float inverse = 1.0f / squaredScale;
+		return normalFromColumns(a0 * inverse, a1 * inverse, a2 * inverse, glm::vec3(m[3]));
+	}
+
+	// column i of the inverse transpose is the cross product of the other two over the determinant
+	glm::vec3 c0 = glm::cross(a1, a2);
+	float inverseDeterminant = 1.0f / glm::dot(a0, c0);
+	return normalFromColumns(c0 * inverseDeterminant, glm::cross(a2, a0) * inverseDeterminant,
+		glm::cross(a0, a1) * inverseDeterminant, glm::vec3(m[3]));
+}
+
+void MatrixMath::normalMatrixBatch(const glm::mat4* m, glm::mat4* out, int count)
+{
+	int i = 0;
+#ifdef MATRIX_MATH_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		// transposed so that each register holds one element of the 4 matrices: a[column][row]
+		__m128 a[4][4];
+		for (int c = 0; c < 4; c++)
+		{
+			for (int lane = 0; lane < 4; lane++)
+			{
+				a[c][lane] = _mm_loadu_ps(&m[i + lane][c][0]);
+			}
+			_MM_TRANSPOSE4_PS(a[c][0], a[c][1], a[c][2], a[c][3]);
+		}
+
+		__m128 squaredScale = dot3(a[0], a[0]);
+		__m128 tolerance = _mm_mul_ps(squaredScale, _mm_set1_ps(UNIFORM_TOLERANCE));
+		__m128 uniform = _mm_cmpgt_ps(squaredScale, _mm_setzero_ps());
+		uniform = _mm_and_ps(uniform, _mm_cmple_ps(absolute(_mm_sub_ps(dot3(a[1], a[1]), squaredScale)), tolerance));
+		uniform = _mm_and_ps(uniform, _mm_cmple_ps(absolute(_mm_sub_ps(dot3(a[2], a[2]), squaredScale)), tolerance));
+		uniform = _mm_and_ps(uniform, _mm_cmple_ps(absolute(dot3(a[0], a[1])), tolerance));
+		uniform = _mm_and_ps(uniform, _mm_cmple_ps(absolute(dot3(a[0], a[2])), tolerance));
+		uniform = _mm_and_ps(uniform, _mm_cmple_ps(absolute(dot3(a[1], a[2])), tolerance));
+
+		__m128 n[3][3];
+		if (_mm_movemask_ps(uniform) == 0xF)
+		{
+			// all four are rotations with uniform scale, the common case of the scene
+			__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), squaredScale);
+			for (int c = 0; c < 3; c++)
+			{
+				for (int r = 0; r < 3; r++)
+				{
+					n[c][r] = _mm_mul_ps(a[c][r], inverse);
+				}
+			}
+		}
+		else
+		{
+			cross3(a[1], a[2], n[0]);
+			cross3(a[2], a[0], n[1]);
+			cross3(a[0], a[1], n[2]);
+			__m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), dot3(a[0], n[0]));
+			for (int c = 0; c < 3; c++)
+			{
+				for (int r = 0; r < 3; r++)
+				{
+					n[c][r] = _mm_mul_ps(n[c][r], inverse);
+				}
+			}
+		}
+
+		// back to one matrix per lane; the last row holds minus the columns dotted with the translation
+		__m128 zero = _mm_setzero_ps();
+		for (int c = 0; c < 3; c++)
+		{
+			__m128 rows[4] = { n[c][0], n[c][1], n[c][2], _mm_sub_ps(zero, dot3(n[c], a[3])) };
+			_MM_TRANSPOSE4_PS(rows[0], rows[1], rows[2], rows[3]);
+			for (int lane = 0; lane < 4; lane++)
+			{
+				_mm_storeu_ps(&out[i + lane][c][0], rows[lane]);
+			}
+		}
+		for (int lane = 0; lane < 4; lane++)
+		{
+			out[i + lane][3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		}
+	}
+#endif
+	for (; i < count; i++)
+	{
+		out[i] = normalMatrix(m[i]);
+	}
+}
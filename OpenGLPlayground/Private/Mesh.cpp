@@ -0,0 +1,135 @@
+#include "Mesh.h"
+#include <limits>
+#include "GLState.h"
+#include "GeometryCache.h"
+
+Mesh::Mesh()
+	: vao{ 0 }
+	, mode{ GL_TRIANGLES }
+	, count{ 0 }
+	, indexType{ GL_NONE }
+	, indexOffset{ 0 }
+	, baseVertex{ 0 }
+	, ownsVao{ false }
+	, bounds{ 0.0f, 0.0f, 0.0f, std::numeric_limits<float>::infinity() }
+{
+}
+
+void Mesh::create(GLenum drawMode, GLsizei drawCount)
+{
+	glGenVertexArrays(1, &vao);
+	mode = drawMode;
+	count = drawCount;
+	indexType = GL_NONE;
+	indexOffset = 0;
+	baseVertex = 0;
+	ownsVao = true;
+}
+
+void Mesh::createFromGeometry(const GeometryRange* range)
+{
+	create(range->mode, range->numIndices);
+
+	// vertices are interleaved at the start of the range, indices follow them in the same buffer
+	setVertexBuffer(0, range->buffer, 0, range->vertexStride);
+	setAttribute(0, 3, 0, 0);
+	if (range->format == VertexFormat::PosTexNorm)
+	{
+		setAttribute(1, 2, 0, 3 * sizeof(float));
+		setAttribute(2, 3, 0, 5 * sizeof(float));
+	}
+	setIndexBuffer(range->buffer, range->indexType, range->indexOffset);
+}
+
+void Mesh::createView(GLuint sharedVao, GLenum drawMode, GLsizei drawCount, GLenum type, GLintptr offset, GLint firstVertex)
+{
+	vao = sharedVao;
+	mode = drawMode;
+	count = drawCount;
+	indexType = type;
+	indexOffset = offset;
+	baseVertex = firstVertex;
+	ownsVao = false;
+}
+
+void Mesh::destroy()
+{
+	if (ownsVao)
+	{
+		GLState::deleteVertexArrays(1, &vao);
+	}
+	vao = 0;
+}
+
+void Mesh::setVertexBuffer(GLuint bindingIndex, GLuint buffer, GLintptr offset, GLsizei stride)
+{
+	GLState::bindVertexArray(vao);
+	glBindVertexBuffer(bindingIndex, buffer, offset, stride);
+	GLState::bindVertexArray(0);
+}
+
+void Mesh::setAttribute(GLuint location, GLint size, GLuint bindingIndex, GLuint relativeOffset)
+{
+	GLState::bindVertexArray(vao);
+	glVertexAttribFormat(location, size, GL_FLOAT, GL_FALSE, relativeOffset);
+	glVertexAttribBinding(location, bindingIndex);
+	glEnableVertexAttribArray(location);
+	GLState::bindVertexArray(0);
+}
+
+void Mesh::setIndexBuffer(GLuint buffer, GLenum type, GLintptr offset)
+{
+	// the element buffer binding is part of the vertex array state
+	GLState::bindVertexArray(vao);
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+	GLState::bindVertexArray(0);
+	indexType = type;
+	indexOffset = offset;
+}
+
+void Mesh::setBindingDivisor(GLuint bindingIndex, GLuint divisor)
+{
+	GLState::bindVertexArray(vao);
+	glVertexBindingDivisor(bindingIndex, divisor);
+	GLState::bindVertexArray(0);
+}
+
+void Mesh::setBounds(const glm::vec3& center, float radius)
+{
+	bounds = glm::vec4(center, radius);
+}
+
+void Mesh::bind() const
+{
+	GLState::bindVertexArray(vao);
+}
+
+void Mesh::draw() const
+{
+	if (indexType != GL_NONE)
+	{
+		glDrawElementsBaseVertex(mode, count, indexType, (void*)indexOffset, baseVertex);
+	}
+	else
+	{
+		glDrawArrays(mode, 0, count);
+	}
+}
+
+void Mesh::drawInstanced(GLsizei instanceCount) const
+{
+	if (indexType != GL_NONE)
+	{
+		glDrawElementsInstancedBaseVertex(mode, count, indexType, (void*)indexOffset, instanceCount, baseVertex);
+	}
+	else
+	{
+		glDrawArraysInstanced(mode, 0, count, instanceCount);
+	}
+}
+
+DrawElementsIndirectCommand Mesh::getIndirectCommand(GLuint instanceCount, GLuint baseInstance) const
+{
+	GLuint indexSize = indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+	return { (GLuint)count, instanceCount, (GLuint)(indexOffset / indexSize), baseVertex, baseInstance };
+}
@@ -0,0 +1,111 @@
+#include <cstddef>
+#include "MeshArena.h"
+#include "GLState.h"
+
+MeshArena::MeshArena()
+	: vao{ 0 }
+	, vertexBuffer{ 0 }
+	, indexBuffer{ 0 }
+	, drawIdBuffer{ 0 }
+	, drawIdCapacity{ 0 }
+{
+}
+
+void MeshArena::init()
+{
+	glGenVertexArrays(1, &vao);
+	glGenBuffers(1, &vertexBuffer);
+	glGenBuffers(1, &indexBuffer);
+	glGenBuffers(1, &drawIdBuffer);
+
+	GLState::bindVertexArray(vao);
+	glBindVertexBuffer(0, vertexBuffer, 0, sizeof(ArenaVertex));
+	glVertexAttribFormat(0, 3, GL_FLOAT, GL_FALSE, offsetof(ArenaVertex, position));
+	glVertexAttribFormat(1, 2, GL_FLOAT, GL_FALSE, offsetof(ArenaVertex, texCoord));
+	glVertexAttribFormat(2, 3, GL_FLOAT, GL_FALSE, offsetof(ArenaVertex, normal));
+	for (GLuint location = 0; location < 3; location++)
+	{
+		glVertexAttribBinding(location, 0);
+		glEnableVertexAttribArray(location);
+	}
+
+	// multi-draw has no draw index in GL 4.3, each draw's base instance picks its id out of this buffer instead
+	glBindVertexBuffer(1, drawIdBuffer, 0, sizeof(GLuint));
+	glVertexBindingDivisor(1, 1);
+	glVertexAttribIFormat(DRAW_ID_LOCATION, 1, GL_UNSIGNED_INT, 0);
+	glVertexAttribBinding(DRAW_ID_LOCATION, 1);
+	glEnableVertexAttribArray(DRAW_ID_LOCATION);
+
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	GLState::bindVertexArray(0);
+
+	reserveDraws(1024);
+}
+
+Mesh MeshArena::add(const std::vector<ArenaVertex>& meshVertices, const std::vector<GLuint>& meshIndices, GLenum mode)
+{
+	Mesh mesh;
+	mesh.createView(vao, mode, (GLsizei)meshIndices.size(), GL_UNSIGNED_INT,
+		indices.size() * sizeof(GLuint), (GLint)vertices.size());
+
+	// a sphere around the center of the box, not the tightest one but cheap and close for these shapes
+	glm::vec3 low = meshVertices[0].position;
+	glm::vec3 high = meshVertices[0].position;
+	for (const ArenaVertex& vertex : meshVertices)
+	{
+		low = glm::min(low, vertex.position);
+		high = glm::max(high, vertex.position);
+	}
+	glm::vec3 center = (low + high) * 0.5f;
+	float radius = 0.0f;
+	for (const ArenaVertex& vertex : meshVertices)
+	{
+		radius = glm::max(radius, glm::length(vertex.position - center));
+	}
+	mesh.setBounds(center, radius);
+
+	vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+	indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+	return mesh;
+}
+
+Mesh MeshArena::add(const std::vector<ArenaVertex>& meshVertices)
+{
+	std::vector<GLuint> sequential(meshVertices.size());
+	for (size_t i = 0; i < sequential.size(); i++)
+	{
+		sequential[i] = (GLuint)i;
+	}
+	return add(meshVertices, sequential);
+}
+
+void MeshArena::upload()
+{
+	GLState::bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(ArenaVertex), &vertices[0], GL_STATIC_DRAW);
+
+	// the element buffer binding belongs to the vertex array, go through it rather than disturbing another one
+	GLState::bindVertexArray(vao);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+	GLState::bindVertexArray(0);
+}
+
+void MeshArena::reserveDraws(int numDraws)
+{
+	if (numDraws <= drawIdCapacity)
+	{
+		return;
+	}
+	while (drawIdCapacity < numDraws)
+	{
+		drawIdCapacity = drawIdCapacity > 0 ? drawIdCapacity * 2 : 1024;
+	}
+
+	std::vector<GLuint> ids(drawIdCapacity);
+	for (int i = 0; i < drawIdCapacity; i++)
+	{
+		ids[i] = (GLuint)i;
+	}
+	GLState::bindBuffer(GL_ARRAY_BUFFER, drawIdBuffer);
+	glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(GLuint), &ids[0], GL_STATIC_DRAW);
+}
@@ -0,0 +1,54 @@
+#include "OffscreenTarget.h"
+#include <SOIL2/SOIL2.h>
+#include <cstring>
+
+OffscreenTarget::OffscreenTarget()
+	: framebuffer{ 0 }
+	, colorBuffer{ 0 }
+	, depthBuffer{ 0 }
+	, width{ 0 }
+	, height{ 0 }
+{
+}
+
+bool OffscreenTarget::init(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+
+	// the same formats as a usual window, so the passes see the precision they would there
+	glGenRenderbuffers(1, &colorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+bool OffscreenTarget::savePng(const std::string& path)
+{
+	pixels.resize((size_t)width * height * 3);
+	flipped.resize(pixels.size());
+
+	GLint previous;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+
+	// GL rows start at the bottom
+	size_t rowSize = (size_t)width * 3;
+	for (int y = 0; y < height; y++)
+	{
+		memcpy(&flipped[y * rowSize], &pixels[(height - 1 - y) * rowSize], rowSize);
+	}
+	return SOIL_save_image(path.c_str(), SOIL_SAVE_TYPE_PNG, width, height, 3, flipped.data()) != 0;
+}
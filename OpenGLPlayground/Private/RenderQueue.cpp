@@ -0,0 +1,513 @@
+#include "RenderQueue.h"
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include "GLState.h"
+#include "MatrixMath.h"
+
+// sort key layout, most significant first:
+// program 6 bits | texture 8 | material 4 | vertex array 7 | strip 1 | depth 18 | item index 20
+// strips and lists of one vertex array are kept apart, a multi-draw covers one draw mode
+// GL object names are small integers in this application, so their low bits are enough to group them
+namespace
+{
+	constexpr uint64_t INDEX_MASK = (1ull << 20) - 1;
+	constexpr int OBJECT_BATCH_SIZE = 256; // items per job, 256 ObjectData fill whole cache lines so batches never share one
+	constexpr int RECORD_BATCH_SIZE = 4096; // sorted keys per command list, a multi-draw run is split where lists meet
+
+	uint64_t field(uint64_t value, int bits, int shift)
+	{
+		return (value & ((1ull << bits) - 1)) << shift;
+	}
+
+	// positive floats compare like their bit patterns, the top 18 bits keep the exponent and 10 bits of mantissa
+	uint64_t depthBits(float depth)
+	{
+		if (!(depth > 0.0f))
+		{
+			return 0;
+		}
+		uint32_t bits;
+		memcpy(&bits, &depth, sizeof(bits));
+		return bits >> 13;
+	}
+}
+
+RenderQueue::RenderQueue()
+	: allInAllPasses{ true }
+	, full{ false }
+	, programs{}
+	, depthPrograms{}
+	, arena{ nullptr }
+	, ring{ nullptr }
+	, stream{ nullptr }
+	, storageAlignment{ 256 }
+	, numDraws{ 0 }
+	, numInstances{ 0 }
+	, numStateChanges{ 0 }
+	, numCulled{}
+	, streamed{}
+	, streamedBuffers{}
+	, streamedOffsets{}
+{
+}
+
+void RenderQueue::init(MeshArena* meshArena, UniformRing* objectRing, StreamBuffer* streamBuffer)
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+	arena = meshArena;
+	ring = objectRing;
+	stream = streamBuffer;
+	storageAlignment = alignment;
+}
+
+void RenderQueue::setPrograms(int pass, const PassPrograms& passPrograms)
+{
+	programs[pass] = passPrograms;
+}
+
+void RenderQueue::setDepthPrograms(const PassPrograms& passPrograms)
+{
+	depthPrograms = passPrograms;
+}
+
+void RenderQueue::clear()
+{
+	items.clear();
+	full = false;
+}
+
+bool RenderQueue::add(const DrawItem& item)
+{
+	// one more would alias the keys of the first items, and the wrong ones would be drawn
+	if (items.size() > INDEX_MASK)
+	{
+		if (!full)
+		{
+			std::cout << "render queue: more than " << INDEX_MASK + 1 << " items, the rest are not drawn" << std::endl;
+			full = true;
+		}
+		return false;
+	}
+	items.push_back(item);
+	return true;
+}
+
+void RenderQueue::computeBounds(const TransformHierarchy& transforms)
+{
+	culler.clear();
+	allInAllPasses = true;
+	for (const DrawItem& item : items)
+	{
+		allInAllPasses = allInAllPasses && item.passMask == ALL_PASSES;
+
+		// every mesh of an item covers the same shape, whichever pass it is drawn in
+		const Mesh* mesh = item.meshes[(item.passMask & SHADOW_PASS_BIT) ? SHADOW_PASS : LIT_PASS];
+		const Transform& world = transforms.getWorld(item.transform);
+		const glm::vec4& bounds = mesh->getBounds();
+		culler.add(world.transformPoint(glm::vec3(bounds)), bounds.w * world.scale);
+	}
+}
+
+void RenderQueue::computeObjects(const TransformHierarchy& transforms, const glm::mat4 shadowMatrices[NUM_RENDER_PASSES], JobSystem& jobs)
+{
+	for (int pass = 0; pass < NUM_RENDER_PASSES; pass++)
+	{
+		itemObjects[pass].resize(items.size());
+	}
+	jobs.parallelFor((int)items.size(), OBJECT_BATCH_SIZE, [&](int begin, int end)
+	{
+		// the shadow pass only reads sh_mvp_matrix
+		for (int i = begin; i < end; i++)
+		{
+			// world transforms become matrices here, on their way to the GPU, and nowhere else
+			const Transform& world = transforms.getWorld(items[i].transform);
+			glm::vec4 rows[3];
+			world.toAffineRows(rows);
+			glm::mat4 matrix = glm::transpose(glm::mat4(rows[0], rows[1], rows[2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+
+			// the normal matrix of s R is R / s, the model rows divided by s squared
+			float normalScale = 1.0f / (world.scale * world.scale);
+			for (int pass = 0; pass < NUM_RENDER_PASSES; pass++)
+			{
+				if (items[i].passMask & (1u << pass))
+				{
+					ObjectData& object = itemObjects[pass][i];
+					if (pass != SHADOW_PASS)
+					{
+						for (int r = 0; r < 3; r++)
+						{
+							object.mMatrix[r] = rows[r];
+							object.nMatrix[r] = glm::vec4(glm::vec3(rows[r]) * normalScale, 0.0f);
+						}
+					}
+					object.shMvpMatrix = MatrixMath::multiply(shadowMatrices[pass], matrix);
+				}
+			}
+		}
+	});
+}
+
+void RenderQueue::cull(int pass, const Frustum& frustum)
+{
+	visible.clear();
+	culler.cull(frustum, visible);
+
+	if (allInAllPasses)
+	{
+		numCulled[pass] = (int)items.size() - (int)visible.size();
+		return;
+	}
+
+	// items outside the pass are dropped here too, only the ones that were in it count as culled
+	int numInPass = 0;
+	int kept = 0;
+	for (const DrawItem& item : items)
+	{
+		numInPass += (item.passMask & (1u << pass)) ? 1 : 0;
+	}
+	for (int index : visible)
+	{
+		if (items[index].passMask & (1u << pass))
+		{
+			visible[kept++] = index;
+		}
+	}
+	visible.resize(kept);
+	numCulled[pass] = numInPass - kept;
+}
+
+void RenderQueue::sort(int pass, const glm::mat4& viewMatrix, const TransformHierarchy& transforms)
+{
+	std::vector<uint64_t>& passKeys = keys[pass];
+	passKeys.clear();
+	for (int i : visible)
+	{
+		const DrawItem& item = items[i];
+
+		// distance along the view direction of the object's origin
+		glm::vec4 viewPos = viewMatrix * glm::vec4(transforms.getWorld(item.transform).translation, 1.0f);
+
+		uint64_t key = field(programFor(item, pass), 6, 58)
+			| field(item.texture, 8, 50)
+			| field(item.material, 4, 46)
+			| field(item.meshes[pass]->getVao(), 7, 39)
+			| field(item.meshes[pass]->getMode() == GL_TRIANGLE_STRIP, 1, 38)
+			| field(depthBits(-viewPos.z), 18, 20)
+			| field(i, 20, 0);
+		passKeys.push_back(key);
+	}
+	radixSort(passKeys);
+}
+
+void RenderQueue::record(int pass, JobSystem& jobs)
+{
+	const std::vector<uint64_t>& passKeys = keys[pass];
+	int numKeys = (int)passKeys.size();
+	int numLists = (numKeys + RECORD_BATCH_SIZE - 1) / RECORD_BATCH_SIZE;
+	commandLists[pass].resize(numLists);
+
+	// every multi-drawable key takes the next slot of the object storage, so each list's first slot is known up front
+	listSlots.resize(numLists + 1);
+	jobs.parallelFor(numKeys, RECORD_BATCH_SIZE, [&](int begin, int end)
+	{
+		int count = 0;
+		for (int k = begin; k < end; k++)
+		{
+			count += isMultiDrawable(items[passKeys[k] & INDEX_MASK], pass) ? 1 : 0;
+		}
+		listSlots[begin / RECORD_BATCH_SIZE + 1] = count;
+	});
+	listSlots[0] = 0;
+	for (int list = 0; list < numLists; list++)
+	{
+		listSlots[list + 1] += listSlots[list];
+	}
+	objects[pass].resize(listSlots[numLists]);
+	commands[pass].resize(listSlots[numLists]);
+
+	jobs.parallelFor(numKeys, RECORD_BATCH_SIZE, [&](int begin, int end)
+	{
+		int list = begin / RECORD_BATCH_SIZE;
+		recordRange(pass, begin, end, listSlots[list], commandLists[pass][list]);
+	});
+	streamed[pass] = false;
+}
+
+void RenderQueue::execute(int pass, MaterialBinder bindMaterial)
+{
+	replay(pass, bindMaterial);
+}
+
+void RenderQueue::executeDepth(int pass)
+{
+	replay(pass, nullptr);
+}
+
+// bindMaterial is null for depth only: the depth programs, and no textures or materials
+void RenderQueue::replay(int pass, MaterialBinder bindMaterial)
+{
+	// the pass's object data and multi-draw commands are streamed as one allocation, the commands right after the objects;
+	// a pass replayed twice in a frame, as depth and then lit, reuses it
+	const std::vector<ObjectData>& passObjects = objects[pass];
+	const std::vector<DrawElementsIndirectCommand>& passCommands = commands[pass];
+	GLintptr commandOffset = 0;
+	if (!passCommands.empty())
+	{
+		GLsizeiptr objectBytes = passObjects.size() * sizeof(ObjectData);
+		if (!streamed[pass])
+		{
+			arena->reserveDraws((int)passObjects.size());
+			GLsizeiptr commandBytes = passCommands.size() * sizeof(DrawElementsIndirectCommand);
+			StreamAllocation allocation = stream->allocate(objectBytes + commandBytes, storageAlignment);
+			memcpy(allocation.data, &passObjects[0], objectBytes);
+			memcpy((char*)allocation.data + objectBytes, &passCommands[0], commandBytes);
+			stream->flush();
+			streamedBuffers[pass] = allocation.buffer;
+			streamedOffsets[pass] = allocation.offset;
+			streamed[pass] = true;
+		}
+
+		GLState::bindBufferRange(GL_SHADER_STORAGE_BUFFER, OBJECT_STORAGE_BINDING, streamedBuffers[pass], streamedOffsets[pass], objectBytes);
+		GLState::bindBuffer(GL_DRAW_INDIRECT_BUFFER, streamedBuffers[pass]);
+		commandOffset = streamedOffsets[pass] + objectBytes;
+	}
+
+	// nothing is assumed about the state left behind by other code; binds are compared again because every list
+	// was recorded from unknown state, so the first ones of a list usually repeat what the list before left bound
+	GLuint currentProgram = 0;
+	GLuint currentVao = 0;
+	GLuint currentTexture = 0xFFFFFFFF;
+	GLuint currentMaterial = 0xFFFFFFFF;
+	GLenum currentFrontFace = GL_NONE;
+
+	numDraws = 0;
+	numInstances = 0;
+	numStateChanges = 0;
+	GLState::activeTexture(GL_TEXTURE0);
+
+	for (const std::vector<Command>& list : commandLists[pass])
+	{
+		for (const Command& command : list)
+		{
+			switch (command.type)
+			{
+			case BIND_PROGRAM:
+			{
+				GLuint program = bindMaterial != nullptr ? command.value : depthProgramFor(command.value, pass);
+				if (program != currentProgram)
+				{
+					currentProgram = program;
+					GLState::useProgram(currentProgram);
+					numStateChanges++;
+				}
+				break;
+			}
+			case BIND_MESH:
+			{
+				const Mesh* mesh = items[command.value].meshes[pass];
+				if (mesh->getVao() != currentVao)
+				{
+					currentVao = mesh->getVao();
+					mesh->bind();
+					numStateChanges++;
+				}
+				break;
+			}
+			case BIND_TEXTURE:
+				if (bindMaterial != nullptr && command.value != currentTexture)
+				{
+					currentTexture = command.value;
+					GLState::bindTexture(GL_TEXTURE_2D, currentTexture);
+					numStateChanges++;
+				}
+				break;
+			case BIND_MATERIAL:
+				if (bindMaterial != nullptr && command.value != currentMaterial)
+				{
+					currentMaterial = command.value;
+					bindMaterial((int)currentMaterial);
+					numStateChanges++;
+				}
+				break;
+			case SET_FRONT_FACE:
+				if (command.value != currentFrontFace)
+				{
+					currentFrontFace = command.value;
+					GLState::frontFace(currentFrontFace);
+					numStateChanges++;
+				}
+				break;
+			case DRAW:
+			{
+				const DrawItem& item = items[command.value];
+				ring->push(&itemObjects[pass][command.value]);
+				if (item.instanceCount > 0)
+				{
+					item.meshes[pass]->drawInstanced(item.instanceCount);
+					numInstances += item.instanceCount;
+				}
+				else
+				{
+					item.meshes[pass]->draw();
+					numInstances++;
+				}
+				numDraws++;
+				break;
+			}
+			case MULTI_DRAW:
+			{
+				const Mesh* mesh = items[command.value].meshes[pass];
+				glMultiDrawElementsIndirect(mesh->getMode(), mesh->getIndexType(),
+					(void*)(commandOffset + command.firstCommand * sizeof(DrawElementsIndirectCommand)), command.numCommands, 0);
+				numInstances += command.numCommands;
+				numDraws++;
+				break;
+			}
+			}
+		}
+	}
+}
+
+// the depth program that draws like the given program of the pass
+GLuint RenderQueue::depthProgramFor(GLuint program, int pass) const
+{
+	if (program == programs[pass].instanced)
+	{
+		return depthPrograms.instanced;
+	}
+	return program == programs[pass].multiDraw ? depthPrograms.multiDraw : depthPrograms.single;
+}
+
+GLuint RenderQueue::programFor(const DrawItem& item, int pass) const
+{
+	if (item.instanceCount > 0)
+	{
+		return programs[pass].instanced;
+	}
+	return isMultiDrawable(item, pass) ? programs[pass].multiDraw : programs[pass].single;
+}
+
+bool RenderQueue::isMultiDrawable(const DrawItem& item, int pass) const
+{
+	return arena != nullptr && item.instanceCount == 0 && item.meshes[pass]->getVao() == arena->getVao();
+}
+
+bool RenderQueue::sameState(const DrawItem& a, const DrawItem& b, int pass) const
+{
+	const Mesh* meshA = a.meshes[pass];
+	const Mesh* meshB = b.meshes[pass];
+	if (meshA->getMode() != meshB->getMode() || meshA->getIndexType() != meshB->getIndexType() || a.frontFace != b.frontFace)
+	{
+		return false;
+	}
+	return pass == SHADOW_PASS || (a.texture == b.texture && a.material == b.material);
+}
+
+// records the draws of a range of sorted keys, with the binds that change state within the range
+// multi-drawable keys write their command and object data from firstSlot on, nothing else is shared with other ranges
+void RenderQueue::recordRange(int pass, int begin, int end, int firstSlot, std::vector<Command>& list)
+{
+	const std::vector<uint64_t>& passKeys = keys[pass];
+	std::vector<ObjectData>& passObjects = objects[pass];
+	std::vector<DrawElementsIndirectCommand>& passCommands = commands[pass];
+	GLuint currentProgram = 0;
+	GLuint currentVao = 0;
+	GLuint currentTexture = 0xFFFFFFFF;
+	int currentMaterial = -1;
+	GLenum currentFrontFace = GL_NONE;
+	int slot = firstSlot;
+
+	list.clear();
+	for (int k = begin; k < end; k++)
+	{
+		GLuint index = (GLuint)(passKeys[k] & INDEX_MASK);
+		const DrawItem& item = items[index];
+		const Mesh* mesh = item.meshes[pass];
+		bool multiDraw = isMultiDrawable(item, pass);
+		if (multiDraw)
+		{
+			// the base instance is the draw's slot in the object storage
+			passCommands[slot] = mesh->getIndirectCommand(1, (GLuint)slot);
+			passObjects[slot] = itemObjects[pass][index];
+			slot++;
+
+			// binds come before their draw, a multi-draw at the end of the list is still the state that is bound
+			if (!list.empty() && list.back().type == MULTI_DRAW && sameState(items[list.back().value], item, pass))
+			{
+				list.back().numCommands++;
+				continue;
+			}
+		}
+
+		GLuint program = programFor(item, pass);
+		if (program != currentProgram)
+		{
+			currentProgram = program;
+			list.push_back({ BIND_PROGRAM, program, 0, 0 });
+		}
+		if (mesh->getVao() != currentVao)
+		{
+			currentVao = mesh->getVao();
+			list.push_back({ BIND_MESH, index, 0, 0 });
+		}
+		// depth-only rendering reads neither textures nor materials
+		if (pass != SHADOW_PASS && item.texture != currentTexture)
+		{
+			currentTexture = item.texture;
+			list.push_back({ BIND_TEXTURE, currentTexture, 0, 0 });
+		}
+		if (pass != SHADOW_PASS && item.material != currentMaterial)
+		{
+			currentMaterial = item.material;
+			list.push_back({ BIND_MATERIAL, (GLuint)currentMaterial, 0, 0 });
+		}
+		if (item.frontFace != currentFrontFace)
+		{
+			currentFrontFace = item.frontFace;
+			list.push_back({ SET_FRONT_FACE, currentFrontFace, 0, 0 });
+		}
+		if (multiDraw)
+		{
+			list.push_back({ MULTI_DRAW, index, (GLuint)slot - 1, 1 });
+		}
+		else
+		{
+			list.push_back({ DRAW, index, 0, 0 });
+		}
+	}
+}
+
+// least significant digit first, 8 bits per pass; passes where every key has the same digit are skipped
+void RenderQueue::radixSort(std::vector<uint64_t>& keys)
+{
+	size_t count = keys.size();
+	scratch.resize(count);
+	for (int shift = 0; shift < 64; shift += 8)
+	{
+		size_t histogram[256] = {};
+		for (uint64_t key : keys)
+		{
+			histogram[(key >> shift) & 0xFF]++;
+		}
+		if (count == 0 || histogram[(keys[0] >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		size_t offset = 0;
+		for (int digit = 0; digit < 256; digit++)
+		{
+			size_t bucket = histogram[digit];
+			histogram[digit] = offset;
+			offset += bucket;
+		}
+		for (uint64_t key : keys)
+		{
+			scratch[histogram[(key >> shift) & 0xFF]++] = key;
+		}
+		keys.swap(scratch);
+	}
+}
@@ -0,0 +1,109 @@
+#include <iostream>
+#include <vector>
+#include "Utils.h"
+#include "ShaderProgram.h"
+
+ShaderProgram::ShaderProgram()
+	: id{ 0 }
+{
+}
+
+void ShaderProgram::create(const char* vp, const char* fp)
+{
+	id = Utils::createShaderProgram(vp, fp);
+	reflect();
+}
+
+void ShaderProgram::createCompute(const char* cp)
+{
+	id = Utils::createComputeProgram(cp);
+	reflect();
+}
+
+GLint ShaderProgram::uniform(const std::string& name)
+{
+	return lookup(uniforms, name, "uniform");
+}
+
+GLint ShaderProgram::attribute(const std::string& name)
+{
+	return lookup(attributes, name, "attribute");
+}
+
+GLint ShaderProgram::uniformBlock(const std::string& name)
+{
+	return lookup(uniformBlocks, name, "uniform block");
+}
+
+GLint ShaderProgram::storageBlock(const std::string& name)
+{
+	return lookup(storageBlocks, name, "storage block");
+}
+
+void ShaderProgram::reflect()
+{
+	uniforms.clear();
+	attributes.clear();
+	uniformBlocks.clear();
+	storageBlocks.clear();
+
+	reflectInterface(GL_UNIFORM, uniforms);
+	reflectInterface(GL_PROGRAM_INPUT, attributes);
+	reflectInterface(GL_UNIFORM_BLOCK, uniformBlocks);
+	reflectInterface(GL_SHADER_STORAGE_BLOCK, storageBlocks);
+}
+
+void ShaderProgram::reflectInterface(GLenum programInterface, std::unordered_map<std::string, GLint>& table)
+{
+	GLint numResources = 0;
+	GLint maxNameLength = 0;
+	glGetProgramInterfaceiv(id, programInterface, GL_ACTIVE_RESOURCES, &numResources);
+	glGetProgramInterfaceiv(id, programInterface, GL_MAX_NAME_LENGTH, &maxNameLength);
+	std::vector<GLchar> name(maxNameLength + 1);
+
+	// blocks are addressed by their resource index, everything else by location
+	bool isBlock = programInterface == GL_UNIFORM_BLOCK || programInterface == GL_SHADER_STORAGE_BLOCK;
+	for (GLint i = 0; i < numResources; i++)
+	{
+		glGetProgramResourceName(id, programInterface, i, (GLsizei)name.size(), NULL, &name[0]);
+		std::string resourceName(&name[0]);
+		if (isBlock)
+		{
+			table[resourceName] = i;
+			continue;
+		}
+
+		// members of uniform blocks have no location, they are set through their buffer
+		GLint location = -1;
+		GLenum locationProp = GL_LOCATION;
+		glGetProgramResourceiv(id, programInterface, i, 1, &locationProp, 1, NULL, &location);
+		if (location < 0)
+		{
+			continue;
+		}
+		table[resourceName] = location;
+
+		// arrays are reported as "name[0]", also accept the bare name
+		size_t bracket = resourceName.rfind("[0]");
+		if (bracket != std::string::npos && bracket + 3 == resourceName.size())
+		{
+			table[resourceName.substr(0, bracket)] = location;
+		}
+	}
+}
+
+GLint ShaderProgram::lookup(const std::unordered_map<std::string, GLint>& table, const std::string& name, const char* kind)
+{
+	auto it = table.find(name);
+	if (it == table.end())
+	{
+#ifdef _DEBUG
+		// setting it would be silently ignored by GL, so point it out here
+		std::cout << "WARNING::SHADER_PROGRAM " << id << ": " << kind << " '" << name << "' is set but not active" << std::endl;
+#else
+		(void)kind;
+#endif
+		return -1;
+	}
+	return it->second;
+}
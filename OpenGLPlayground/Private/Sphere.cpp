@@ -65,4 +65,7 @@ void Sphere::init(int numSlices)
 			indices[6 * (i * numSlices + j) + 5] = (i + 1) * (numSlices + 1) + j;
 		}
 	}
+
+	// the same quads as one strip per horizontal slice (split along the other diagonal), the upper slice leads to keep the winding
+	stripIndices = Utils::buildGridStrip(numSlices, numSlices, true);
 }
\ No newline at end of file
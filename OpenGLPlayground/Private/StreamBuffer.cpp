@@ -0,0 +1,155 @@
+#include "StreamBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include "GLState.h"
+#include "Utils.h"
+
+// glBufferStorage is GL 4.4, past what the loader was generated for, so it is fetched by hand
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+namespace
+{
+	typedef void (APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+	BufferStorageProc bufferStorage = nullptr;
+
+	constexpr GLsizeiptr REGION_ALIGNMENT = 256; // covers the uniform and storage buffer offset alignments
+	constexpr GLbitfield PERSISTENT_FLAGS = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+}
+
+StreamBuffer::StreamBuffer()
+	: mapped{ nullptr }
+	, buffer{ 0 }
+	, regionSize{ 0 }
+	, numRegions{ 0 }
+	, region{ 0 }
+	, head{ 0 }
+	, flushed{ 0 }
+	, persistent{ false }
+	, bytesStreamed{ 0 }
+	, fenceWaitTime{ 0.0 }
+{
+}
+
+void StreamBuffer::init(GLsizeiptr frameSize, int numFrames)
+{
+	bufferStorage = (BufferStorageProc)Utils::loadGLFunction("glBufferStorage", 4, 4, "GL_ARB_buffer_storage");
+	persistent = bufferStorage != nullptr;
+	numRegions = numFrames;
+	create(frameSize);
+	std::cout << "stream buffer: " << numRegions << " x " << regionSize << " bytes, "
+		<< (persistent ? "persistently mapped" : "unsynchronized maps") << std::endl;
+}
+
+void StreamBuffer::beginFrame()
+{
+	region = (region + 1) % numRegions;
+	head = 0;
+	flushed = 0;
+	bytesStreamed = 0;
+	fenceWaitTime = 0.0;
+
+	GLsync& fence = fences[region];
+	if (fence == 0)
+	{
+		return;
+	}
+	auto start = std::chrono::high_resolution_clock::now();
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (result == GL_TIMEOUT_EXPIRED)
+	{
+		result = glClientWaitSync(fence, 0, 1000000);
+	}
+	fenceWaitTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	glDeleteSync(fence);
+	fence = 0;
+}
+
+StreamAllocation StreamBuffer::allocate(GLsizeiptr size, GLsizeiptr alignment)
+{
+	GLintptr offset = (head + alignment - 1) / alignment * alignment;
+	if (offset + size > regionSize)
+	{
+		// the new buffer is idle, so every region starts out free
+		flush();
+		retire();
+		create(std::max(regionSize * 2, size));
+		std::cout << "stream buffer grown to " << numRegions << " x " << regionSize << " bytes" << std::endl;
+		offset = 0;
+	}
+	head = offset + size;
+	bytesStreamed += size;
+
+	GLintptr regionStart = region * regionSize;
+	void* data = persistent ? (void*)(mapped + regionStart + offset) : (void*)&shadow[offset];
+	return { data, buffer, regionStart + offset };
+}
+
+void StreamBuffer::flush()
+{
+	// coherent persistent writes are seen by every command issued after them
+	if (persistent || head == flushed)
+	{
+		return;
+	}
+
+	// the region's fence has been waited on, nothing in flight reads this range
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	void* range = glMapBufferRange(GL_COPY_WRITE_BUFFER, region * regionSize + flushed, head - flushed,
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	memcpy(range, &shadow[flushed], head - flushed);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	flushed = head;
+}
+
+void StreamBuffer::endFrame()
+{
+	flush();
+	fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	// GL keeps their storage alive until the draws already issued with them have finished
+	if (!retired.empty())
+	{
+		GLState::deleteBuffers((GLsizei)retired.size(), &retired[0]);
+		retired.clear();
+	}
+}
+
+void StreamBuffer::create(GLsizeiptr frameSize)
+{
+	regionSize = (frameSize + REGION_ALIGNMENT - 1) / REGION_ALIGNMENT * REGION_ALIGNMENT;
+	fences.assign(numRegions, 0);
+	head = 0;
+	flushed = 0;
+
+	glGenBuffers(1, &buffer);
+	GLState::bindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (persistent)
+	{
+		bufferStorage(GL_COPY_WRITE_BUFFER, regionSize * numRegions, NULL, PERSISTENT_FLAGS);
+		mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * numRegions, PERSISTENT_FLAGS);
+	}
+	else
+	{
+		glBufferData(GL_COPY_WRITE_BUFFER, regionSize * numRegions, NULL, GL_STREAM_DRAW);
+		shadow.resize(regionSize);
+	}
+}
+
+void StreamBuffer::retire()
+{
+	for (GLsync fence : fences)
+	{
+		if (fence != 0)
+		{
+			glDeleteSync(fence);
+		}
+	}
+	// a persistent mapping ends with the buffer
+	retired.push_back(buffer);
+	mapped = nullptr;
+}
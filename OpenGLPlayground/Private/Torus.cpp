@@ -110,5 +110,7 @@ void Torus::init()
 			indices[((ring * numRings + vert) * 2 + 1) * 3 + 2] = (ring + 1) * (numRings + 1) + vert + 1;
 		}
 	}
-}
 
+	// the same triangles as one strip per ring, the current ring leads to keep the winding
+	stripIndices = Utils::buildGridStrip(numRings, numRings, false);
+}
@@ -0,0 +1,55 @@
+#include "Transform.h"
+
+Transform::Transform()
+	: translation{ 0.0f }
+	, scale{ 1.0f }
+	, rotation{ 1.0f, 0.0f, 0.0f, 0.0f }
+{
+}
+
+Transform::Transform(const glm::vec3& translation, const glm::quat& rotation, float scale)
+	: translation{ translation }
+	, scale{ scale }
+	, rotation{ rotation }
+{
+}
+
+Transform Transform::fromAxisAngle(const glm::vec3& translation, float angle, const glm::vec3& axis, float scale)
+{
+	return Transform(translation, glm::angleAxis(angle, glm::normalize(axis)), scale);
+}
+
+Transform Transform::operator*(const Transform& child) const
+{
+	// p -> t + s R (child.t + child.s child.R p)
+	return Transform(translation + scale * (rotation * child.translation), rotation * child.rotation, scale * child.scale);
+}
+
+Transform Transform::inverse() const
+{
+	glm::quat inverseRotation = glm::conjugate(rotation);
+	float inverseScale = 1.0f / scale;
+	return Transform(-inverseScale * (inverseRotation * translation), inverseRotation, inverseScale);
+}
+
+glm::vec3 Transform::transformPoint(const glm::vec3& point) const
+{
+	return translation + scale * (rotation * point);
+}
+
+glm::mat4 Transform::toMatrix() const
+{
+	glm::mat3 basis = glm::mat3_cast(rotation) * scale;
+	glm::mat4 out(basis);
+	out[3] = glm::vec4(translation, 1.0f);
+	return out;
+}
+
+void Transform::toAffineRows(glm::vec4 rows[3]) const
+{
+	glm::mat3 basis = glm::mat3_cast(rotation);
+	for (int r = 0; r < 3; r++)
+	{
+		rows[r] = glm::vec4(basis[0][r] * scale, basis[1][r] * scale, basis[2][r] * scale, translation[r]);
+	}
+}
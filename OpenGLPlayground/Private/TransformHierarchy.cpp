@@ -0,0 +1,104 @@
+#include "TransformHierarchy.h"
+#include <algorithm>
+
+namespace
+{
+	constexpr int BLEND_BATCH_SIZE = 4096; // nodes per job
+
+	// translation and scale linearly, rotation with a normalized lerp along the shorter arc, which is as good as a
+	// slerp for the small turn of one step
+	Transform blend(const Transform& from, const Transform& to, float alpha)
+	{
+		glm::quat rotation = glm::dot(from.rotation, to.rotation) < 0.0f ? -to.rotation : to.rotation;
+		Transform result;
+		result.translation = glm::mix(from.translation, to.translation, alpha);
+		result.scale = from.scale + (to.scale - from.scale) * alpha;
+		result.rotation = glm::normalize(from.rotation * (1.0f - alpha) + rotation * alpha);
+		return result;
+	}
+}
+
+TransformHierarchy::TransformHierarchy()
+	: drawn{ nullptr }, numUpdated{ 0 }
+{
+}
+
+int TransformHierarchy::addNode(int parent, const Transform& local)
+{
+	parents.push_back(parent);
+	locals.push_back(local);
+	worlds.push_back(local);
+	dirty.push_back(1);
+	previous.clear();
+	drawn = worlds.data();
+	return (int)parents.size() - 1;
+}
+
+void TransformHierarchy::truncate(int numNodes)
+{
+	parents.resize(numNodes);
+	locals.resize(numNodes);
+	worlds.resize(numNodes);
+	dirty.resize(numNodes);
+	previous.clear();
+	drawn = worlds.data();
+}
+
+void TransformHierarchy::setLocal(int node, const Transform& local)
+{
+	locals[node] = local;
+	dirty[node] = 1;
+}
+
+void TransformHierarchy::update()
+{
+	numUpdated = 0;
+	int numNodes = (int)parents.size();
+	for (int i = 0; i < numNodes; i++)
+	{
+		int parent = parents[i];
+		if (parent >= 0 && dirty[parent])
+		{
+			dirty[i] = 1; // parents come first, so their flag is final by the time a child reads it
+		}
+		if (dirty[i])
+		{
+			worlds[i] = parent >= 0 ? worlds[parent] * locals[i] : locals[i];
+			numUpdated++;
+		}
+	}
+
+	// flags are cleared afterwards so that every descendant saw its parent's
+	std::fill(dirty.begin(), dirty.end(), 0);
+	drawn = worlds.data();
+}
+
+void TransformHierarchy::storePrevious()
+{
+	previous = worlds;
+}
+
+void TransformHierarchy::interpolate(float alpha, JobSystem& jobs)
+{
+	int numNodes = (int)worlds.size();
+	if ((int)previous.size() != numNodes)
+	{
+		drawn = worlds.data();
+		return;
+	}
+	if (alpha <= 0.0f)
+	{
+		drawn = previous.data();
+		return;
+	}
+
+	blended.resize(numNodes);
+	jobs.parallelFor(numNodes, BLEND_BATCH_SIZE, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			blended[i] = blend(previous[i], worlds[i], alpha);
+		}
+	});
+	drawn = blended.data();
+}
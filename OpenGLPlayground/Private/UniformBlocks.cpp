@@ -0,0 +1,31 @@
+#include "UniformBlocks.h"
+#include <cstring>
+#include "GLState.h"
+
+UniformRing::UniformRing()
+	: stream{ nullptr }
+	, binding{ 0 }
+	, size{ 0 }
+	, alignment{ 256 }
+{
+}
+
+void UniformRing::init(StreamBuffer* streamBuffer, GLuint bindingIndex, GLsizeiptr dataSize)
+{
+	// bound ranges must start at a multiple of the offset alignment
+	GLint offsetAlignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+
+	stream = streamBuffer;
+	binding = bindingIndex;
+	size = dataSize;
+	alignment = offsetAlignment;
+}
+
+void UniformRing::push(const void* data)
+{
+	StreamAllocation allocation = stream->allocate(size, alignment);
+	memcpy(allocation.data, data, size);
+	stream->flush();
+	GLState::bindBufferRange(GL_UNIFORM_BUFFER, binding, allocation.buffer, allocation.offset, size);
+}
@@ -1,8 +1,14 @@
 #include "Utils.h"
+#include <cstring>
+#include <algorithm>
 #include <SOIL2/SOIL2.h>
 #include <filesystem>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include "GLState.h"
+
+GLADloadproc Utils::glLoader = (GLADloadproc)glfwGetProcAddress;
+float Utils::maxAnisotropy = 16.0f;
 
 std::string Utils::getCurrentPath()
 {
@@ -55,6 +61,25 @@ GLuint Utils::createShaderProgram(const char* vp, const char* fp)
     return vfProgram;
 }
 
+GLuint Utils::createComputeProgram(const char* cp)
+{
+    GLuint cShader = glCreateShader(GL_COMPUTE_SHADER);
+
+    std::string compShaderStr = readShaderSource(cp);
+    const char* compShaderSrc = compShaderStr.c_str();
+
+    glShaderSource(cShader, 1, &compShaderSrc, NULL);
+    glCompileShader(cShader);
+    checkCompileErrors(cShader, "COMPUTE");
+
+    GLuint cProgram = glCreateProgram();
+    glAttachShader(cProgram, cShader);
+    glLinkProgram(cProgram);
+    checkCompileErrors(cProgram, "PROGRAM");
+
+    return cProgram;
+}
+
 void Utils::checkCompileErrors(GLuint shader, const std::string& type)
 {
     GLint compiled;
@@ -89,7 +114,7 @@ GLuint Utils::loadTexture(const std::string& directoryPath, const std::string& t
     }
 
     // if mipmapping
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    GLState::bindTexture(GL_TEXTURE_2D, textureID);
     //glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -98,11 +123,16 @@ GLuint Utils::loadTexture(const std::string& directoryPath, const std::string& t
     // if also anisotropic filtering
     GLfloat anisoSetting = 0.0f;
     glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &anisoSetting);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, anisoSetting);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(anisoSetting, maxAnisotropy));
 
     return textureID;
 }
 
+void Utils::setMaxAnisotropy(float anisotropy)
+{
+    maxAnisotropy = std::max(anisotropy, 1.0f);
+}
+
 float Utils::toRadians(float degrees)
 {
     return (degrees * 2.0f * 3.14159f) / 360.0f;
@@ -120,3 +150,54 @@ void Utils::calculateNormal(const float* verts, float* outNormal)
 	outNormal[1] = normal.y;
 	outNormal[2] = normal.z;
 }
+
+
+std::vector<GLuint> Utils::buildGridStrip(int numCols, int numRows, bool nextRowFirst)
+{
+    // one strip per row of quads, rows are joined with the restart index
+    // nextRowFirst picks which row leads each pair, which decides the winding of the strip
+    std::vector<GLuint> strip;
+    strip.reserve(numRows * (2 * (numCols + 1) + 1));
+    for (int row = 0; row < numRows; row++)
+    {
+        if (row > 0)
+        {
+            strip.push_back(restartIndex);
+        }
+        for (int col = 0; col <= numCols; col++)
+        {
+            GLuint lower = row * (numCols + 1) + col;
+            GLuint upper = (row + 1) * (numCols + 1) + col;
+            strip.push_back(nextRowFirst ? upper : lower);
+            strip.push_back(nextRowFirst ? lower : upper);
+        }
+    }
+    return strip;
+}
+
+bool Utils::hasGLSupport(int major, int minor, const char* extension)
+{
+    GLint contextMajor = 0;
+    GLint contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    bool supported = contextMajor > major || (contextMajor == major && contextMinor >= minor);
+
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions && !supported; i++)
+    {
+        supported = strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), extension) == 0;
+    }
+    return supported;
+}
+
+void* Utils::loadGLFunction(const char* name, int major, int minor, const char* extension)
+{
+    return hasGLSupport(major, minor, extension) ? glLoader(name) : nullptr;
+}
+
+void Utils::setGLLoader(GLADloadproc loader)
+{
+    glLoader = loader;
+}
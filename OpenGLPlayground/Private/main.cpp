@@ -3,48 +3,166 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <cmath>
-#include <stack>
+#include <cstring>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include "Utils.h"
-#include "Sphere.h"
-#include "Torus.h"
+#include "ShaderProgram.h"
+#include "UniformBlocks.h"
+#include "GeometryCache.h"
+#include "ComputeMeshGenerator.h"
+#include "Mesh.h"
+#include "MeshArena.h"
+#include "TransformHierarchy.h"
+#include "FrameMailbox.h"
+#include "FrameStats.h"
+#include "FramePacer.h"
+#include "HeadlessContext.h"
+#include "OffscreenTarget.h"
+#include "GLState.h"
+#include "GpuCuller.h"
+#include "HiZPyramid.h"
+#include "JobSystem.h"
+#include "AnimationSystem.h"
+#include "MatrixMath.h"
+#include "RenderQueue.h"
+#include "InstanceBuffer.h"
 #include "ImportedModel.h"
 
 constexpr GLuint SCR_WIDTH = 800;
 constexpr GLuint SCR_HEIGHT = 600;
-constexpr GLuint NUM_VAOS = 1;
-constexpr GLuint NUM_VBOS = 17;
 constexpr GLsizei cubeStride = 8 * sizeof(float);
+constexpr int NUM_FRAGMENT_QUERIES = 3; // results are read a couple of frames late, when the GPU has them
+constexpr int NUM_GPU_TIMESTAMPS = 4; // at the start, after the shadow pass, after the depth prepass and after the lit pass
+constexpr double HEADLESS_FRAME_TIME = 1.0 / 60.0; // headless runs advance their clock this much per frame, so they replay exactly
+constexpr int MAX_SIMULATION_STEPS = 5; // per frame, time beyond them is dropped and the simulation falls behind the clock
+
+#ifndef GL_FRAGMENT_SHADER_INVOCATIONS
+#define GL_FRAGMENT_SHADER_INVOCATIONS 0x82F4
+#endif
 
 std::string resourcePath;
 float cameraX, cameraY, cameraZ;
-GLuint renderingProgram1, renderingProgram2;
-GLuint vao[NUM_VAOS];
-GLuint vbo[NUM_VBOS];
-Sphere mySphere(48);
-Torus myTorus(0.5f, 0.2f, 48);
+ShaderProgram renderingProgram1, renderingProgram2;
+ShaderProgram instancedProgram1, instancedProgram2; // same passes, transforms fetched per instance
+ShaderProgram multiDrawProgram1, multiDrawProgram2; // same passes, object data fetched per draw of a multi-draw call
+ShaderProgram depthProgram, depthInstancedProgram, depthMultiDrawProgram; // camera depth prepass, positions only
+GLuint cubeVbo; // the belt's own copy of the cube, every other mesh lives in the arena
 ImportedModel myShuttle("shuttle.obj");
 ImportedModel myDolphin("dolphinHighPoly.obj");
+GeometryCache geometryCache; // procedural shapes, generated once each and placed in the arena
+ComputeMeshGenerator meshGenerator;
+GeometryRange animatedTorus; // written by the compute generator, used by both passes when animateTorus is set
+Mesh animatedTorusMesh;
+bool animateTorus = false; // toggled with the A key, the torus is then regenerated on the GPU every frame with pulsing radii
+bool meshGeneratorValidated = false; // against the CPU shapes, the first time the torus is animated
+
+// every static mesh is a range of the arena, both passes draw them with multi-draw calls
+MeshArena meshArena;
+Mesh pyramidMesh, cubeMesh, sphereMesh, torusMesh, shuttleMesh, dolphinMesh;
+
+// asteroid belt stress test, small cubes drawn with a single instanced draw per pass
+InstanceBuffer beltInstances;
+Mesh beltMesh, beltDepthMesh;
+int beltNode;
+const int beltInstanceCounts[] = { 0, 1000, 10000, 100000, 1000000 }; // cycled with the B key
+
+// scene transforms, animated and evaluated once per frame and read by both passes
+TransformHierarchy sceneGraph;
+AnimationSystem animation;
+int sunNode, sunSpinNode, planetNode, planetSpinNode, moonNode, sphereNode, torusNode, shuttleNode, dolphinNode;
+int numSceneNodes; // stress nodes are appended after the scene's own nodes
+int numSceneAnimated; // and their animations after the scene's
+int stressSpinCurve; // a turn about y in quarter-turn keys
+int numStressNodes = 0;
+bool drawStressNodes = false; // toggled with the D key, each stress node is then drawn as a small pyramid
+const int stressNodeCounts[] = { 0, 1000, 10000, 100000 }; // cycled with the T key
+FrameStats frameStats; // printed once per second, toggled with the F key
+FramePacer framePacer; // vsync toggled with the V key, the frame rate limit cycled with the L key
+const double targetFpsValues[] = { 0.0, 30.0, 60.0, 144.0 }; // frame rate limits, 0 for none
+// toggled with the I key, frames are then only drawn after input or when the window asks; nothing tracks whether the
+// scene moves, so the animation stands still between inputs; the idle time is then dropped like steps that ran late
+bool renderOnDemand = false;
+int pendingRedraws = 0;
+bool headless = false; // drawing into offscreenTarget without a window, see runHeadless()
+OffscreenTarget offscreenTarget;
+float textureAnisotropy = -1.0f; // set with --anisotropy, otherwise chosen in init(): software renderers pay a sample per step
+std::atomic<double> headlessClock{ 0.0 };
+JobSystem jobSystem; // the update thread and its workers, one core is left to the main thread
+GpuCuller gpuCuller; // static field of pyramids and cubes, culled and drawn without CPU work per object
+const int gpuObjectCounts[] = { 0, 10000, 100000 }; // cycled with the G key
+int beltCount = 0; // chosen by the update thread, the main thread resizes the buffers to match
+int gpuObjectCount = 0;
+
+// the scene is animated in fixed steps, as many per frame as the clock asks for, and drawn between the last two
+const double simulationRates[] = { 60.0, 120.0, 10.0, 30.0 }; // steps per second, cycled with the U key
+double simulationRate = 60.0;
+double simulationTime = -1.0; // of the last step, the first frame starts the simulation at the clock's time
+double previousSimulationTime; // of the step before
+double simulationAccumulator = 0.0; // clock time not simulated yet, less than a step after each frame
+double lastSimulationClock;
+HiZPyramid hiZ; // camera depth pyramid, built halfway through the lit pass and reused by the next frame
+bool occlusionCulling = true; // toggled with the H key, the lit pass then skips GPU-culled objects hidden by others
+bool fragmentQueriesSupported = false; // pipeline statistics queries are core in 4.6
+GLuint fragmentQueries[NUM_FRAGMENT_QUERIES][2]; // the count pauses while the pyramid is built, its depth copy may be a draw
+int fragmentQuerySegments[NUM_FRAGMENT_QUERIES]; // queries of the frame that hold a result
+int fragmentQueryIndex = 0;
+GLuint gpuTimestamps[NUM_FRAGMENT_QUERIES][NUM_GPU_TIMESTAMPS]; // read as late as the fragment queries
+bool gpuTimestampsWritten[NUM_FRAGMENT_QUERIES];
+bool gpuTimestampsPrepass[NUM_FRAGMENT_QUERIES]; // whether the frame that wrote them ran the depth prepass
+double gpuTimestampsInterval[NUM_FRAGMENT_QUERIES]; // the interval of the frame that wrote them, 0 until it was presented
+int gpuTimestampIndex = 0;
+bool depthPrepass = false; // toggled with the P key, the lit pass then shades every pixel of the queued objects once
+
+// the update thread animates the scene and prepares both passes while the main thread, which owns the GL context,
+// draws the frame before; the scene, camera and light matrices belong to the update thread, which copies what
+// drawing needs into a packet, and the main thread reads nothing else of them
+struct FramePacket
+{
+    std::chrono::steady_clock::time_point start; // when its update began, for the latency
+    double time;
+    RenderQueue queue; // culled and sorted in both passes, only execute() is left
+    glm::mat4 vMat, pMat, lightVmatrix, lightPmatrix;
+    glm::vec3 lightPos;
+    int beltCount;
+    int gpuObjectCount;
+    bool occlusionCulling;
+    bool animateTorus;
+    FrameStats stats; // of the update, merged into frameStats when the packet is drawn
+};
+FramePacket framePackets[FrameMailbox::NUM_SLOTS];
+FrameMailbox frameMailbox;
+std::thread updateThread;
+std::mutex updateCommandMutex;
+std::vector<std::function<void()>> updateCommands; // input handled by the update thread before its next frame
+RenderQueue recordingQueue; // of the R key's benchmark, set up in init() where the GL context is current
 
 // allocate variables used in display() function, so that they wont need to be allocated during rendering
 int width, height;
 float aspect;
-glm::mat4 mMat, vMat, pMat, invTrMat;
+glm::mat4 vMat, pMat;
 glm::vec3 currLightPos, lightPosV;
 float lightPos[3];
-std::stack<glm::mat4> trfmStack;
 GLuint brickTexture;
 GLuint earthTexture;
 GLuint shuttleTexture;
 
-// shader uniform locations
-GLuint mLoc, vLoc, pLoc, nLoc, shLoc;
-GLuint lightAmbLoc, lightDifLoc, lightSpeLoc, lightPosLoc;
-GLuint matAmbLoc, matDifLoc, matSpeLoc, matShiLoc;
-GLuint globalAmbLoc, winSizeLoc;
+// uniform buffers backing the shaders' std140 blocks, see UniformBlocks.h
+GLuint frameUbo, materialUbo;
+GLsizeiptr materialStride;
+StreamBuffer streamBuffer; // everything written per frame, fenced so that up to 3 frames can be in flight
+UniformRing objectRing;
+FrameData frameData, uploadedFrameData;
 
 // light properties
 glm::vec3 initLightPos(-5.0f, 3.0f, 4.0f);
@@ -53,18 +171,14 @@ float lightAmb[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 float lightDif[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 float lightSpe[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 
-// material properties
-float* matAmb = Utils::silverAmbient();
-float* matDif = Utils::silverDiffuse();
-float* matSpe = Utils::silverSpecular();
-float matShi = Utils::silverShininess();
+// material properties, in the order they are stored in the material uniform buffer
+enum Material { GOLD, SILVER, BRONZE, NUM_MATERIALS };
 
 // shadow-related variables
 int screenSizeX, screenSizeY;
 GLuint shadowTex, shadowBuffer;
 glm::mat4 lightVmatrix;
 glm::mat4 lightPmatrix;
-glm::mat4 shadowMVP;
 glm::mat4 b;
 
 void calcPyramidNormals(const float* verts, float* outNormals)
@@ -81,6 +195,16 @@ void calcPyramidNormals(const float* verts, float* outNormals)
     }
 }
 
+std::vector<ArenaVertex> interleave(const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& texCoords, const std::vector<glm::vec3>& normals)
+{
+    std::vector<ArenaVertex> vertices(positions.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+        vertices[i] = { positions[i], texCoords[i], normals[i] };
+    }
+    return vertices;
+}
+
 void setupVertices()
 {
     // 36 vertices, 12 triangles, makes 2x2x2 cube placed at origin
@@ -130,6 +254,13 @@ void setupVertices()
         -1.0f, -1.0f, -1.0f,    0.0f, -1.0f, 0.0f,   1.0f, 0.0f
     };
 
+    // the table is wound clockwise, swap two corners of every triangle so that all meshes are counter-clockwise
+    for (int tri = 0; tri < 12; tri++)
+    {
+        float* corner = cubeData + tri * 3 * 8;
+        std::swap_ranges(corner + 8, corner + 16, corner + 16);
+    }
+
     // pyramid with 18 vertices, comprising 6 triangles (four sides, and two on the bottom)
     float pyrVerts[54] =
     {
@@ -178,172 +309,218 @@ void setupVertices()
     float pyrNorms[54];
     calcPyramidNormals(pyrVerts, pyrNorms);
 
-    glGenVertexArrays(NUM_VAOS, vao);
-    glBindVertexArray(*vao);
+    glGenBuffers(1, &cubeVbo);
+    GLState::bindBuffer(GL_ARRAY_BUFFER, cubeVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeData), cubeData, GL_STATIC_DRAW);
 
-    glGenBuffers(NUM_VBOS, vbo);
+    // ---------------------------------- mesh arena ------------------------------------
+    // every static mesh goes into one vertex buffer and one index buffer with a shared layout
+    meshArena.init();
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(cubeData), cubeData, GL_STATIC_DRAW);
-    
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(pyrVerts), pyrVerts, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(pyrTexCoords), pyrTexCoords, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[13]);
-    glBufferData(GL_ARRAY_BUFFER, 54 * sizeof(float), pyrNorms, GL_STATIC_DRAW);
-
-    // ------------------------------ procedural sphere -------------------------------
-    std::vector<int> sphIdxs = mySphere.getIndices();
-    std::vector<glm::vec3> sphVerts = mySphere.getVertices();
-    std::vector<glm::vec2> sphTexs = mySphere.getTexCoords();
-    std::vector<glm::vec3> sphNorms = mySphere.getNormals();
-    std::vector<float> sphPosVals; // vertex positions
-    std::vector<float> sphTexVals; // texture coordinates
-    std::vector<float> sphNormVals; // normal vectors
-
-    // flatten every vector into array of floats
-    int sphNumIdxs = mySphere.getNumIndices();
-    for (int i = 0; i < sphNumIdxs; i++)
-    {
-        sphPosVals.push_back(sphVerts[sphIdxs[i]].x);
-        sphPosVals.push_back(sphVerts[sphIdxs[i]].y);
-        sphPosVals.push_back(sphVerts[sphIdxs[i]].z);
-
-        sphTexVals.push_back(sphTexs[sphIdxs[i]].s);
-        sphTexVals.push_back(sphTexs[sphIdxs[i]].t);
-
-        sphNormVals.push_back(sphNorms[sphIdxs[i]].x);
-        sphNormVals.push_back(sphNorms[sphIdxs[i]].y);
-        sphNormVals.push_back(sphNorms[sphIdxs[i]].z);
-    }
-
-    // put the vertices into buffer #4
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[3]);
-    glBufferData(GL_ARRAY_BUFFER, sphPosVals.size() * 4, &sphPosVals[0], GL_STATIC_DRAW);
-    // put the texture coordinates into buffer #5
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[4]);
-    glBufferData(GL_ARRAY_BUFFER, sphTexVals.size() * 4, &sphTexVals[0], GL_STATIC_DRAW);
-    // put the normals into buffer #6
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[5]);
-    glBufferData(GL_ARRAY_BUFFER, sphNormVals.size() * 4, &sphNormVals[0], GL_STATIC_DRAW);
-    // ----------------------------------------------------------------------------------
+    std::vector<ArenaVertex> cubeVertices(36);
+    for (int i = 0; i < 36; i++)
+    {
+        const float* v = cubeData + i * 8;
+        cubeVertices[i] = { glm::vec3(v[0], v[1], v[2]), glm::vec2(v[6], v[7]), glm::vec3(v[3], v[4], v[5]) };
+    }
+    cubeMesh = meshArena.add(cubeVertices);
 
-    // ------------------------------ procedural torus ----------------------------------
-    std::vector<int> torIdxs = myTorus.getIndices();
-    std::vector<glm::vec3> torVerts = myTorus.getVertices();
-    std::vector<glm::vec2> torTexs = myTorus.getTexCoords();
-    std::vector<glm::vec3> torNorms = myTorus.getNormals();
-    std::vector<float> torPosVals; // vertex positions
-    std::vector<float> torTexVals; // texture coordinates
-    std::vector<float> torNormVals; // normal vectors
-
-    // flatten every vector into array of floats
-    int torNumVerts = myTorus.getNumVertices();
-    for (int i = 0; i < torNumVerts; i++)
-    {
-        torPosVals.push_back(torVerts[i].x);
-        torPosVals.push_back(torVerts[i].y);
-        torPosVals.push_back(torVerts[i].z);
-
-        torTexVals.push_back(torTexs[i].s);
-        torTexVals.push_back(torTexs[i].t);
-
-        torNormVals.push_back(torNorms[i].x);
-        torNormVals.push_back(torNorms[i].y);
-        torNormVals.push_back(torNorms[i].z);
-    }
-
-    // put the vertices into buffer #7
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[6]);
-    glBufferData(GL_ARRAY_BUFFER, torPosVals.size() * 4, &torPosVals[0], GL_STATIC_DRAW);
-    // put the texture coordinates into buffer #8
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[7]);
-    glBufferData(GL_ARRAY_BUFFER, torTexVals.size() * 4, &torTexVals[0], GL_STATIC_DRAW);
-    // put the normals into buffer #9
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[8]);
-    glBufferData(GL_ARRAY_BUFFER, torNormVals.size() * 4, &torNormVals[0], GL_STATIC_DRAW);
-    // put the indices into buffer #10
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[9]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, torIdxs.size() * 4, &torIdxs[0], GL_STATIC_DRAW);
+    std::vector<ArenaVertex> pyrVertices(18);
+    for (int i = 0; i < 18; i++)
+    {
+        pyrVertices[i] = { glm::make_vec3(pyrVerts + i * 3), glm::make_vec2(pyrTexCoords + i * 2), glm::make_vec3(pyrNorms + i * 3) };
+    }
+    pyramidMesh = meshArena.add(pyrVertices);
+
+    // procedural shapes as triangle strips, multi-draws of them are kept apart from the lists by the draw mode
+    sphereMesh = geometryCache.acquireSphere(meshArena, 48);
+    torusMesh = geometryCache.acquireTorus(meshArena, 0.5f, 0.2f, 48);
+    geometryCache.printStats();
+
+    shuttleMesh = meshArena.add(interleave(myShuttle.getVertices(), myShuttle.getTextureCoords(), myShuttle.getNormals()));
+    dolphinMesh = meshArena.add(interleave(myDolphin.getVertices(), myDolphin.getTextureCoords(), myDolphin.getNormals()));
+
+    meshArena.upload();
+    std::cout << "mesh arena: " << meshArena.getResidentBytes() << " bytes" << std::endl;
     // ----------------------------------------------------------------------------------
+}
+
+// meshes that are drawn outside the arena
+void setupMeshes()
+{
+    // belt asteroids read the cube from its own buffer, the instance data comes from binding 3
+    beltMesh.create(GL_TRIANGLES, 36);
+    beltMesh.setVertexBuffer(0, cubeVbo, 0, cubeStride);
+    beltMesh.setAttribute(0, 3, 0, 0);
+    beltMesh.setAttribute(1, 2, 0, 6 * sizeof(float));
+    beltMesh.setAttribute(2, 3, 0, 3 * sizeof(float));
+    beltInstances.attach(beltMesh, 3);
+    beltDepthMesh.create(GL_TRIANGLES, 36);
+    beltDepthMesh.setVertexBuffer(0, cubeVbo, 0, cubeStride);
+    beltDepthMesh.setAttribute(0, 3, 0, 0);
+    beltInstances.attach(beltDepthMesh, 3);
+    // the whole belt is culled as one, asteroids lie within radius 6 and height 0.2 of its node
+    beltMesh.setBounds(glm::vec3(0.0f), 6.1f);
+    beltDepthMesh.setBounds(glm::vec3(0.0f), 6.1f);
+
+    // the generated torus is rewritten on the GPU in its own buffer
+    animatedTorusMesh.createFromGeometry(&animatedTorus);
+    animatedTorusMesh.setBounds(glm::vec3(0.0f), 0.85f); // largest inner plus outer radius
+}
+
+void setupScene()
+{
+    sunNode = sceneGraph.addNode(-1, Transform(glm::vec3(0.0f, 0.0f, 0.0f))); // sun position
+    sunSpinNode = sceneGraph.addNode(sunNode); // sun rotation, child objects don't inherit it
+    planetNode = sceneGraph.addNode(sunNode); // planet orbit, inherited by the moon
+    planetSpinNode = sceneGraph.addNode(planetNode);
+    moonNode = sceneGraph.addNode(planetNode);
+
+    // the placement nodes never change after this, only the spin below them is updated each frame
+    Transform spherePlacement(glm::vec3(-2.0f, 0.0f, 0.0f));
+    sphereNode = sceneGraph.addNode(sceneGraph.addNode(sunNode, spherePlacement));
+
+    Transform torusPlacement = Transform::fromAxisAngle(glm::vec3(2.0f, 0.0f, 0.0f), Utils::toRadians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f), 2.0f);
+    torusNode = sceneGraph.addNode(sceneGraph.addNode(sunNode, torusPlacement));
+
+    shuttleNode = sceneGraph.addNode(sunNode);
+    dolphinNode = sceneGraph.addNode(sunNode);
+    beltNode = sceneGraph.addNode(sunNode);
+    numSceneNodes = sceneGraph.getNumNodes();
+
+    // every motion of the scene, in radians per second
+    glm::vec3 xAxis(1.0f, 0.0f, 0.0f), yAxis(0.0f, 1.0f, 0.0f), zAxis(0.0f, 0.0f, 1.0f);
+    animation.addSpin(animation.addNode(sunSpinNode), xAxis, 1.0f);
+    animation.addOrbit(animation.addNode(planetNode), glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 4.0f), glm::vec3(4.0f, 0.0f, 0.0f), 1.0f);
+    animation.addSpin(animation.addNode(planetSpinNode, Transform(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 0.75f)), yAxis, 1.0f);
+
+    // make the moon smaller
+    int moon = animation.addNode(moonNode, Transform(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 0.25f));
+    animation.addOrbit(moon, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 2.0f), glm::vec3(0.0f, 2.0f, 0.0f), 1.0f);
+    animation.addSpin(moon, zAxis, 1.0f);
+
+    animation.addSpin(animation.addNode(sphereNode), yAxis, 1.0f);
+    animation.addSpin(animation.addNode(torusNode), -yAxis, 1.0f);
+
+    int shuttle = animation.addNode(shuttleNode, Transform(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 4.0f));
+    animation.addOrbit(shuttle, glm::vec3(0.0f), glm::vec3(4.0f, 0.0f, 4.0f), glm::vec3(0.0f, 4.0f, 0.0f), 1.0f);
+    animation.addSpin(shuttle, glm::vec3(1.0f, 1.0f, 0.0f), 1.0f);
+
+    int dolphin = animation.addNode(dolphinNode, Transform(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), 4.0f));
+    animation.addOrbit(dolphin, glm::vec3(0.0f), glm::vec3(4.0f, 0.0f, -4.0f), glm::vec3(0.0f, -4.0f, 0.0f), 1.0f);
+    animation.addSpin(dolphin, glm::vec3(1.0f, 1.0f, 0.0f), -1.0f);
+
+    animation.addSpin(animation.addNode(beltNode), yAxis, 0.1f);
+    numSceneAnimated = animation.getNumAnimated();
+
+    // slerping between quarter turns about one axis gives the exact rotation in between
+    std::vector<float> times;
+    std::vector<glm::quat> rotations;
+    for (int key = 0; key <= 4; key++)
+    {
+        times.push_back(key * 1.5707963f);
+        rotations.push_back(glm::angleAxis(key * 1.5707963f, yAxis));
+    }
+    stressSpinCurve = animation.addRotationCurve(times, rotations);
+}
+
+// undrawn nodes for measuring how the animation and transform update scale, in chains of 8 hanging off the sun
+// every node spins about y and is carried around by the spin: heads with a procedural spin, the rest with a curve
+void setStressNodes(int count)
+{
+    sceneGraph.truncate(numSceneNodes);
+    animation.truncate(numSceneAnimated);
+    for (int i = 0; i < count; i++)
+    {
+        bool chainHead = i % 8 == 0;
+        int node = sceneGraph.addNode(chainHead ? sunNode : sceneGraph.getNumNodes() - 1);
+
+        // chains start in a shell around the sun, scaled down so that their pyramids stay small when drawn
+        glm::vec3 offset = chainHead ? glm::vec3(1.5f + (node % 64) * 0.05f, (node % 13) * 0.1f - 0.6f, 0.0f) : glm::vec3(4.0f, 0.0f, 0.0f);
+        float phase = node * 0.01f;
+        int animated = animation.addNode(node, Transform(glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), chainHead ? 0.05f : 1.0f));
+
+        // the offset turned by the spin's angle
+        animation.addOrbit(animated, glm::vec3(0.0f, offset.y, 0.0f), glm::vec3(offset.x, 0.0f, offset.z), glm::vec3(offset.z, 0.0f, -offset.x), 1.0f, phase);
+        if (chainHead)
+        {
+            animation.addSpin(animated, glm::vec3(0.0f, 1.0f, 0.0f), 1.0f, phase);
+        }
+        else
+        {
+            animation.addRotationTrack(animated, stressSpinCurve, 1.0f, phase);
+        }
+    }
+    numStressNodes = count;
+}
+
+// scatters the asteroids in a flat ring around the sun, the same layout every time for a given count
+void setBeltSize(int count)
+{
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<InstanceData> instances(count);
+    for (InstanceData& instance : instances)
+    {
+        float angle = unit(random) * 6.2831853f;
+        float radius = 4.5f + unit(random) * 1.5f;
+        float height = (unit(random) - 0.5f) * 0.4f;
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 0.01f);
+        float size = 0.01f + unit(random) * 0.02f;
+
+        instance.transform = glm::translate(glm::mat4(1.0f), glm::vec3(cos(angle) * radius, height, sin(angle) * radius));
+        instance.transform *= glm::rotate(glm::mat4(1.0f), unit(random) * 6.2831853f, axis);
+        instance.transform *= glm::scale(glm::mat4(1.0f), glm::vec3(size, size, size));
+        float shade = 0.6f + unit(random) * 0.4f;
+        instance.color = glm::vec4(shade, shade * 0.85f, shade * 0.7f, 1.0f);
+    }
+    beltInstances.upload(instances);
+}
+
+// static objects scattered in a shell around the scene and the camera, most of them out of view
+void setGpuObjects(int count)
+{
+    std::mt19937 random(4321);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<GpuObject> objects(count);
+    for (GpuObject& object : objects)
+    {
+        glm::vec3 direction = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) * 2.0f - 1.0f + 0.001f);
+        float distance = 10.0f + unit(random) * 10.0f;
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + 0.01f);
+        float size = 0.05f + unit(random) * 0.1f;
+
+        object.world = glm::translate(glm::mat4(1.0f), direction * distance);
+        object.world *= glm::rotate(glm::mat4(1.0f), unit(random) * 6.2831853f, axis);
+        object.world *= glm::scale(glm::mat4(1.0f), glm::vec3(size, size, size));
+        object.mesh = unit(random) < 0.5f ? 0 : 1;
+    }
+    gpuCuller.setObjects(objects);
+}
 
-    // ------------------------------- imported shuttle -----------------------------------
-    std::vector<glm::vec3> shuVerts = myShuttle.getVertices();
-    std::vector<glm::vec2> shuTexs = myShuttle.getTextureCoords();
-    std::vector<glm::vec3> shuNorms = myShuttle.getNormals();
-    std::vector<float> shuPosVals; // vertex positions
-    std::vector<float> shuTexVals; // texture coordinates
-    std::vector<float> shuNormVals; // normal vectors
-
-    int shuNumVertices = myShuttle.getNumVertices();
-    for (int i = 0; i < shuNumVertices; i++)
-    {
-        shuPosVals.push_back(shuVerts[i].x);
-        shuPosVals.push_back(shuVerts[i].y);
-        shuPosVals.push_back(shuVerts[i].z);
-        shuTexVals.push_back(shuTexs[i].s);
-        shuTexVals.push_back(shuTexs[i].t);
-        shuNormVals.push_back(shuNorms[i].x);
-        shuNormVals.push_back(shuNorms[i].y);
-        shuNormVals.push_back(shuNorms[i].z);
-    }
-
-    // put the vertices into buffer #11
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[10]);
-    glBufferData(GL_ARRAY_BUFFER, shuPosVals.size() * 4, &shuPosVals[0], GL_STATIC_DRAW);
-    // put the texture coordinates into buffer #12
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[11]);
-    glBufferData(GL_ARRAY_BUFFER, shuTexVals.size() * 4, &shuTexVals[0], GL_STATIC_DRAW);
-    // put the normals into buffer #13
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[12]);
-    glBufferData(GL_ARRAY_BUFFER, shuNormVals.size() * 4, &shuNormVals[0], GL_STATIC_DRAW);
-    // ------------------------------------------------------------------------------------
-
-        // ------------------------------- imported dolphin -----------------------------------
-    std::vector<glm::vec3> dolVerts = myDolphin.getVertices();
-    std::vector<glm::vec2> dolTexs = myDolphin.getTextureCoords();
-    std::vector<glm::vec3> dolNorms = myDolphin.getNormals();
-    std::vector<float> dolPosVals; // vertex positions
-    std::vector<float> dolTexVals; // texture coordinates
-    std::vector<float> dolNormVals; // normal vectors
-
-    int dolNumVertices = myDolphin.getNumVertices();
-    for (int i = 0; i < dolNumVertices; i++)
-    {
-        dolPosVals.push_back(dolVerts[i].x);
-        dolPosVals.push_back(dolVerts[i].y);
-        dolPosVals.push_back(dolVerts[i].z);
-        dolTexVals.push_back(dolTexs[i].s);
-        dolTexVals.push_back(dolTexs[i].t);
-        dolNormVals.push_back(dolNorms[i].x);
-        dolNormVals.push_back(dolNorms[i].y);
-        dolNormVals.push_back(dolNorms[i].z);
-    }
-
-    // put the vertices into buffer #11
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[14]);
-    glBufferData(GL_ARRAY_BUFFER, dolPosVals.size() * 4, &dolPosVals[0], GL_STATIC_DRAW);
-    // put the texture coordinates into buffer #12
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[15]);
-    glBufferData(GL_ARRAY_BUFFER, dolTexVals.size() * 4, &dolTexVals[0], GL_STATIC_DRAW);
-    // put the normals into buffer #13
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[16]);
-    glBufferData(GL_ARRAY_BUFFER, dolNormVals.size() * 4, &dolNormVals[0], GL_STATIC_DRAW);
-    // ----------------------------------------------------------------------------------------
+// the window's framebuffer size, or the offscreen target's in headless runs
+void readFramebufferSize(GLFWwindow* window)
+{
+    if (headless)
+    {
+        width = offscreenTarget.getWidth();
+        height = offscreenTarget.getHeight();
+    }
+    else
+    {
+        glfwGetFramebufferSize(window, &width, &height);
+    }
 }
 
 void setupShadowBuffers(GLFWwindow* window)
 {
-    glfwGetFramebufferSize(window, &width, &height);
+    readFramebufferSize(window);
     
     glGenFramebuffers(1, &shadowBuffer); // create the custom frame buffer
 
     // create the shadow texture and configure it to hold depth information
     glGenTextures(1, &shadowTex);
-    glBindTexture(GL_TEXTURE_2D, shadowTex);
+    GLState::bindTexture(GL_TEXTURE_2D, shadowTex);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -351,6 +528,44 @@ void setupShadowBuffers(GLFWwindow* window)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 }
 
+void setupUniformBuffers()
+{
+    // per-frame block, kept bound for the lifetime of the program
+    glGenBuffers(1, &frameUbo);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+    GLState::bindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, frameUbo);
+    memset(&uploadedFrameData, 0, sizeof(FrameData));
+
+    // static material table, every entry padded to the offset alignment so it can be bound on its own
+    GLint alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    materialStride = (sizeof(MaterialData) + alignment - 1) / alignment * alignment;
+    std::vector<unsigned char> materialBytes(NUM_MATERIALS * materialStride);
+    MaterialData materials[NUM_MATERIALS] =
+    {
+        { glm::make_vec4(Utils::goldAmbient()), glm::make_vec4(Utils::goldDiffuse()), glm::make_vec4(Utils::goldSpecular()), Utils::goldShininess(), { 0.0f, 0.0f, 0.0f } },
+        { glm::make_vec4(Utils::silverAmbient()), glm::make_vec4(Utils::silverDiffuse()), glm::make_vec4(Utils::silverSpecular()), Utils::silverShininess(), { 0.0f, 0.0f, 0.0f } },
+        { glm::make_vec4(Utils::bronzeAmbient()), glm::make_vec4(Utils::bronzeDiffuse()), glm::make_vec4(Utils::bronzeSpecular()), Utils::bronzeShininess(), { 0.0f, 0.0f, 0.0f } }
+    };
+    for (int i = 0; i < NUM_MATERIALS; i++)
+    {
+        memcpy(&materialBytes[i * materialStride], &materials[i], sizeof(MaterialData));
+    }
+    glGenBuffers(1, &materialUbo);
+    GLState::bindBuffer(GL_UNIFORM_BUFFER, materialUbo);
+    glBufferData(GL_UNIFORM_BUFFER, materialBytes.size(), &materialBytes[0], GL_STATIC_DRAW);
+
+    // per-object block, a fresh range of the stream for every draw
+    streamBuffer.init(1024 * 1024, 3);
+    objectRing.init(&streamBuffer, OBJECT_BLOCK_BINDING, sizeof(ObjectData));
+}
+
+void bindMaterial(int material)
+{
+    GLState::bindBufferRange(GL_UNIFORM_BUFFER, MATERIAL_BLOCK_BINDING, materialUbo, material * materialStride, sizeof(MaterialData));
+}
+
 void init(GLFWwindow* window)
 {
     resourcePath = Utils::getResourcePath();
@@ -358,14 +573,66 @@ void init(GLFWwindow* window)
     std::string frag1ShaderPath = resourcePath + "frag1Shader.glsl";
     std::string vert2ShaderPath = resourcePath + "vert2Shader.glsl";
     std::string frag2ShaderPath = resourcePath + "frag2Shader.glsl";
-    renderingProgram1 = Utils::createShaderProgram(vert1ShaderPath.c_str(), frag1ShaderPath.c_str());
-    renderingProgram2 = Utils::createShaderProgram(vert2ShaderPath.c_str(), frag2ShaderPath.c_str());
+    renderingProgram1.create(vert1ShaderPath.c_str(), frag1ShaderPath.c_str());
+    renderingProgram2.create(vert2ShaderPath.c_str(), frag2ShaderPath.c_str());
+    std::string vert1InstancedShaderPath = resourcePath + "vert1InstancedShader.glsl";
+    std::string vert2InstancedShaderPath = resourcePath + "vert2InstancedShader.glsl";
+    instancedProgram1.create(vert1InstancedShaderPath.c_str(), frag1ShaderPath.c_str());
+    instancedProgram2.create(vert2InstancedShaderPath.c_str(), frag2ShaderPath.c_str());
+    std::string vert1MultiDrawShaderPath = resourcePath + "vert1MultiDrawShader.glsl";
+    std::string vert2MultiDrawShaderPath = resourcePath + "vert2MultiDrawShader.glsl";
+    multiDrawProgram1.create(vert1MultiDrawShaderPath.c_str(), frag1ShaderPath.c_str());
+    multiDrawProgram2.create(vert2MultiDrawShaderPath.c_str(), frag2ShaderPath.c_str());
+    depthProgram.create((resourcePath + "vertDepthShader.glsl").c_str(), frag1ShaderPath.c_str());
+    depthInstancedProgram.create((resourcePath + "vertDepthInstancedShader.glsl").c_str(), frag1ShaderPath.c_str());
+    depthMultiDrawProgram.create((resourcePath + "vertDepthMultiDrawShader.glsl").c_str(), frag1ShaderPath.c_str());
+
+    // the blocks are bound by layout qualifiers, make sure the programs actually use them
+    renderingProgram1.uniformBlock("ObjectBlock");
+    renderingProgram2.uniformBlock("FrameBlock");
+    renderingProgram2.uniformBlock("MaterialBlock");
+    renderingProgram2.uniformBlock("ObjectBlock");
+    multiDrawProgram1.storageBlock("ObjectStorage");
+    multiDrawProgram2.storageBlock("ObjectStorage");
 
     cameraX = 0.0f; cameraY = 0.0f; cameraZ = 8.0f;
     currLightPos = glm::vec3(initLightPos);
 
     setupVertices();
     setupShadowBuffers(window);
+    setupUniformBuffers();
+    bindMaterial(SILVER);
+
+    meshGenerator.init();
+    animatedTorus = meshGenerator.createTorus(0.5f, 0.2f, 48, VertexFormat::PosTexNorm);
+    setupMeshes();
+    setupScene();
+    jobSystem.start(std::max((int)std::thread::hardware_concurrency() - 1, 1));
+    std::cout << "job system: " << jobSystem.getNumThreads() << " threads" << std::endl;
+    for (FramePacket& packet : framePackets)
+    {
+        packet.queue.init(&meshArena, &objectRing, &streamBuffer);
+        packet.queue.setPrograms(SHADOW_PASS, { renderingProgram1.getId(), instancedProgram1.getId(), multiDrawProgram1.getId() });
+        packet.queue.setPrograms(LIT_PASS, { renderingProgram2.getId(), instancedProgram2.getId(), multiDrawProgram2.getId() });
+        packet.queue.setDepthPrograms({ depthProgram.getId(), depthInstancedProgram.getId(), depthMultiDrawProgram.getId() });
+    }
+    recordingQueue.init(&meshArena, &objectRing, &streamBuffer);
+    recordingQueue.setPrograms(LIT_PASS, { renderingProgram2.getId(), instancedProgram2.getId(), multiDrawProgram2.getId() });
+    gpuCuller.init(&meshArena, NUM_RENDER_PASSES);
+    gpuCuller.setMeshes({ &pyramidMesh, &cubeMesh }); // GpuObject::mesh 0 and 1
+    hiZ.init(width, height);
+
+    // fragment shader invocations of the lit pass, to see what occlusion culling saves
+    fragmentQueriesSupported = Utils::hasGLSupport(4, 6, "GL_ARB_pipeline_statistics_query");
+    if (fragmentQueriesSupported)
+    {
+        glGenQueries(NUM_FRAGMENT_QUERIES * 2, fragmentQueries[0]);
+    }
+    std::cout << "fragment invocation queries: " << (fragmentQueriesSupported ? "on" : "not supported") << std::endl;
+    glGenQueries(NUM_FRAGMENT_QUERIES * NUM_GPU_TIMESTAMPS, gpuTimestamps[0]);
+
+    // the sphere and tori are drawn as strips split by the largest value of their index type
+    GLState::enable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
 
     b = glm::mat4(
         0.5f, 0.0f, 0.0f, 0.0f,
@@ -374,475 +641,537 @@ void init(GLFWwindow* window)
         0.5f, 0.5f, 0.5f, 1.0f);
 
     // build perspective matrix
-    glfwGetFramebufferSize(window, &width, &height);
+    readFramebufferSize(window);
     aspect = (float)width / (float)height;
     pMat = glm::perspective(1.0472f, aspect, 0.1f, 1000.0f); // 1.0472 radians = 60 degrees
 
+    if (textureAnisotropy < 0.0f)
+    {
+        std::string renderer = (const char*)glGetString(GL_RENDERER);
+        bool software = renderer.find("llvmpipe") != std::string::npos || renderer.find("softpipe") != std::string::npos;
+        textureAnisotropy = software ? 1.0f : 16.0f;
+    }
+    Utils::setMaxAnisotropy(textureAnisotropy);
+    std::cout << "texture anisotropy: " << textureAnisotropy << std::endl;
     brickTexture = Utils::loadTexture(resourcePath, "brick1.jpg");
     earthTexture = Utils::loadTexture(resourcePath, "earthmap1k.jpg");
     shuttleTexture = Utils::loadTexture(resourcePath, "spstob_1.jpg");
+
+    // SOIL binds the textures it creates on its own
+    GLState::invalidate();
 }
 
-void installLights(GLuint renderingProgram)
+void installLights()
 {
     // save the light position in a float array
     lightPos[0] = currLightPos.x;
     lightPos[1] = currLightPos.y;
     lightPos[2] = currLightPos.z;
 
-    // get the locations of the light and material fields in the shader
-    globalAmbLoc = glGetUniformLocation(renderingProgram, "globalAmb");
-    lightAmbLoc = glGetUniformLocation(renderingProgram, "light.ambient");
-    lightDifLoc = glGetUniformLocation(renderingProgram, "light.diffuse");
-    lightSpeLoc = glGetUniformLocation(renderingProgram, "light.specular");
-    lightPosLoc = glGetUniformLocation(renderingProgram, "light.position");
-    matAmbLoc = glGetUniformLocation(renderingProgram, "material.ambient");
-    matDifLoc = glGetUniformLocation(renderingProgram, "material.diffuse");
-    matSpeLoc = glGetUniformLocation(renderingProgram, "material.specular");
-    matShiLoc = glGetUniformLocation(renderingProgram, "material.shininess");
-
-    // set the uniform light and material values in the shader
-    glProgramUniform4fv(renderingProgram, globalAmbLoc, 1, globalAmb);
-    glProgramUniform4fv(renderingProgram, lightAmbLoc, 1, lightAmb);
-    glProgramUniform4fv(renderingProgram, lightDifLoc, 1, lightDif);
-    glProgramUniform4fv(renderingProgram, lightSpeLoc, 1, lightSpe);
-    glProgramUniform3fv(renderingProgram, lightPosLoc, 1, lightPos);
-    glProgramUniform4fv(renderingProgram, matAmbLoc, 1, matAmb);
-    glProgramUniform4fv(renderingProgram, matDifLoc, 1, matDif);
-    glProgramUniform4fv(renderingProgram, matSpeLoc, 1, matSpe);
-    glProgramUniform1f(renderingProgram, matShiLoc, matShi);
-}
-
-void passOne(GLFWwindow* window, double currentTime)
-{
-    glUseProgram(renderingProgram1);
+    // copy the light values into the per-frame block
+    frameData.globalAmbient = glm::make_vec4(globalAmb);
+    frameData.lightAmbient = glm::make_vec4(lightAmb);
+    frameData.lightDiffuse = glm::make_vec4(lightDif);
+    frameData.lightSpecular = glm::make_vec4(lightSpe);
+    frameData.lightPosition = glm::vec4(glm::make_vec3(lightPos), 1.0f);
+}
 
-    glClear(GL_DEPTH_BUFFER_BIT);
-	glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL); // passes if the incoming depth value is less than or equal to the stored depth value
-
-    // reference uniform variables
-    shLoc = glGetUniformLocation(renderingProgram1, "sh_mvp_matrix");
-
-    trfmStack.push(glm::mat4(1.0f)); // + initial matrix
-
-    // ---------------------- pyramid == sun --------------------------------------------
-    trfmStack.push(trfmStack.top()); // ++ copy default matrix
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f)); // sun position
-    trfmStack.push(trfmStack.top()); // +++ push another transform because we want child objects to be relative to the translation above
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(1.0f, 0.0f, 0.0f)); // sun rotation
-    mMat = trfmStack.top();
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW); // the pyramid vertices have counter-clockwise winding order
-        // --- pyramid shadowing ---
-    shadowMVP = lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // ------------------------------
-    glDrawArrays(GL_TRIANGLES, 0, 18); // draw the sun
-    trfmStack.pop(); // ++ sun's axial rotation removed
-    // ----------------------------------------------------------------------------------
+// re-sends the per-frame block only when something in it changed since the last upload
+void uploadFrameData()
+{
+    if (memcmp(&frameData, &uploadedFrameData, sizeof(FrameData)) != 0)
+    {
+        GLState::bindBuffer(GL_UNIFORM_BUFFER, frameUbo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frameData);
+        uploadedFrameData = frameData;
+    }
+}
 
-    // ----------------------- cube == planet -------------------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(sin((float)currentTime) * 4.0, 0.0f, cos((float)currentTime) * 4.0));
-    trfmStack.push(trfmStack.top()); // ++++ push another transform because we want child objects to be relative to the translation above
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(0.0, 1.0, 0.0)); // planet rotation
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(0.75f, 0.75f, 0.75f));
-    mMat = trfmStack.top();
-    
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, cubeStride, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CW); // the cube vertices have clockwise winding order
-        // --- cube shadowing ---
-    shadowMVP = lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // ----------------------
-    glDrawArrays(GL_TRIANGLES, 0, 36); // draw the planet
-    trfmStack.pop(); // +++ planet's rotation axis and scaling removed
-
-    // ----------------------- smaller cube == moon -------------------------------------
-    trfmStack.push(trfmStack.top()); // ++++ inherit planet's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, sin((float)currentTime) * 2.0, cos((float)currentTime) * 2.0));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(0.0, 0.0, 1.0)); // moon rotation
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(0.25f, 0.25f, 0.25f)); // make the moon smaller
-    mMat = trfmStack.top();
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, cubeStride, 0);
-    glEnableVertexAttribArray(0);
-        // --- smaller cube shadowing ---
-    shadowMVP = lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // ------------------------------
-    glDrawArrays(GL_TRIANGLES, 0, 36); // draw the moon
-
-    trfmStack.pop(); // +++ remove moon's transformations
-    trfmStack.pop(); // ++ remove planet's translation
-    // ----------------------------------------------------------------------------------
+void buildRenderQueue(RenderQueue& queue)
+{
+    const Mesh* torus = animateTorus ? &animatedTorusMesh : &torusMesh;
+
+    queue.clear();
+    queue.add({ ALL_PASSES, { &pyramidMesh, &pyramidMesh }, brickTexture, SILVER, GL_CCW, sunSpinNode, 0 }); // sun
+    queue.add({ ALL_PASSES, { &cubeMesh, &cubeMesh }, brickTexture, SILVER, GL_CCW, planetSpinNode, 0 }); // planet
+    queue.add({ ALL_PASSES, { &cubeMesh, &cubeMesh }, 0, SILVER, GL_CCW, moonNode, 0 }); // moon
+    queue.add({ ALL_PASSES, { &sphereMesh, &sphereMesh }, earthTexture, SILVER, GL_CCW, sphereNode, 0 });
+    queue.add({ ALL_PASSES, { torus, torus }, brickTexture, SILVER, GL_CCW, torusNode, 0 });
+    queue.add({ ALL_PASSES, { &shuttleMesh, &shuttleMesh }, shuttleTexture, SILVER, GL_CCW, shuttleNode, 0 });
+    queue.add({ ALL_PASSES, { &dolphinMesh, &dolphinMesh }, 0, SILVER, GL_CCW, dolphinNode, 0 });
+    if (beltCount > 0)
+    {
+        queue.add({ ALL_PASSES, { &beltDepthMesh, &beltMesh }, 0, BRONZE, GL_CCW, beltNode, beltCount });
+    }
+    if (drawStressNodes)
+    {
+        for (int node = numSceneNodes; node < sceneGraph.getNumNodes(); node++)
+        {
+            queue.add({ ALL_PASSES, { &pyramidMesh, &pyramidMesh }, 0, GOLD, GL_CCW, node, 0 });
+        }
+    }
+}
 
-    // ------------------------------ procedural sphere ---------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(-2.0f, 0.0f, 0.0f));
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(0.0f, 1.0f, 0.0f));
-    mMat = trfmStack.top();
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[3]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW); // the sphere vertices have clockwise winding order
-        // --- sphere shadowing ---
-    shadowMVP = lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // ------------------------
-    glDrawArrays(GL_TRIANGLES, 0, mySphere.getNumIndices());
-
-    trfmStack.pop(); // ++ remove procedural sphere's transformations
-    // ----------------------------------------------------------------------------------
+// culls, sorts and records on the update thread, so that drawing the packet only replays it
+void preparePass(FramePacket& packet, int pass, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix)
+{
+    {
+        ScopedTimer timer(packet.stats, "cull");
+        packet.queue.cull(pass, Frustum::fromMatrix(projectionMatrix * viewMatrix));
+    }
+    packet.stats.addCount(pass == SHADOW_PASS ? "shadow culled" : "lit culled", packet.queue.getNumCulled(pass));
+    {
+        ScopedTimer timer(packet.stats, "sort");
+        packet.queue.sort(pass, viewMatrix, sceneGraph);
+    }
+    {
+        ScopedTimer timer(packet.stats, "record");
+        packet.queue.record(pass, jobSystem);
+    }
+}
 
-    // ------------------------------ procedural torus ----------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.0f, 0.0f));
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 2.0f, 2.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), Utils::toRadians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(0.0f, -1.0, 0.0f));
-    mMat = trfmStack.top();
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[6]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW);
-        // --- torus shadowing ----
-    shadowMVP = lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // ------------------------
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[9]);
-    glDrawElements(GL_TRIANGLES, myTorus.getNumIndices(), GL_UNSIGNED_INT, 0);
-
-    trfmStack.pop(); // ++ remove procedural torus's transformations
-    // ----------------------------------------------------------------------------------
+void submitPass(FramePacket& packet, int pass)
+{
+    packet.queue.execute(pass, bindMaterial);
+    frameStats.addCount("draws", packet.queue.getNumDraws());
+    frameStats.addCount("instances", packet.queue.getNumInstances());
+    frameStats.addCount("state changes", packet.queue.getNumStateChanges());
+}
 
-    // ------------------------------- imported shuttle -----------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(cos((float)currentTime) * 4.0f, sin((float)currentTime) * 4.0f, cos((float)currentTime) * 4.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(1.0, 1.0, 0.0));
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(4.0f, 4.0f, 4.0f));
-    mMat = trfmStack.top();
+// reads the oldest frame's count if the GPU is done with it, then starts counting this frame's lit pass
+void beginFragmentQuery()
+{
+    if (!fragmentQueriesSupported)
+    {
+        return;
+    }
+    fragmentQueryIndex = (fragmentQueryIndex + 1) % NUM_FRAGMENT_QUERIES;
+    GLuint* queries = fragmentQueries[fragmentQueryIndex];
+    int numSegments = fragmentQuerySegments[fragmentQueryIndex];
+    if (numSegments > 0)
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[numSegments - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 fragments = 0;
+            for (int segment = 0; segment < numSegments; segment++)
+            {
+                GLuint64 segmentFragments = 0;
+                glGetQueryObjectui64v(queries[segment], GL_QUERY_RESULT, &segmentFragments);
+                fragments += segmentFragments;
+            }
+            frameStats.addCount("lit fragments", (double)fragments);
+        }
+    }
+    glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, queries[0]);
+    fragmentQuerySegments[fragmentQueryIndex] = 1;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[10]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW);
-        // --- shuttle shadowing ----
-    shadowMVP = lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // --------------------------
-    glDrawArrays(GL_TRIANGLES, 0, myShuttle.getNumVertices());
+void pauseFragmentQuery()
+{
+    if (fragmentQueriesSupported)
+    {
+        glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+    }
+}
 
-    trfmStack.pop(); // ++ remove shuttle's transformations
-    // ------------------------------------------------------------------------------------
+void resumeFragmentQuery()
+{
+    if (fragmentQueriesSupported)
+    {
+        glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS, fragmentQueries[fragmentQueryIndex][1]);
+        fragmentQuerySegments[fragmentQueryIndex] = 2;
+    }
+}
+
+void endFragmentQuery()
+{
+    pauseFragmentQuery();
+}
 
-    // ------------------------------- imported dolphin -----------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(cos((float)currentTime) * 4.0f, -sin((float)currentTime) * 4.0f, -cos((float)currentTime) * 4.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), -(float)currentTime, glm::vec3(1.0, 1.0, 0.0));
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(4.0f, 4.0f, 4.0f));
-    mMat = trfmStack.top();
+// reads the oldest frame's timestamps if the GPU is done with them, then lets this frame write over them
+void beginGpuTimestamps()
+{
+    gpuTimestampIndex = (gpuTimestampIndex + 1) % NUM_FRAGMENT_QUERIES;
+    GLuint* queries = gpuTimestamps[gpuTimestampIndex];
+    if (gpuTimestampsWritten[gpuTimestampIndex])
+    {
+        GLuint available = 0;
+        glGetQueryObjectuiv(queries[NUM_GPU_TIMESTAMPS - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 times[NUM_GPU_TIMESTAMPS];
+            for (int i = 0; i < NUM_GPU_TIMESTAMPS; i++)
+            {
+                glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &times[i]);
+            }
+            if (gpuTimestampsPrepass[gpuTimestampIndex])
+            {
+                frameStats.addTime("prepass GPU", (times[2] - times[1]) / 1000000.0);
+            }
+            frameStats.addTime("lit GPU", (times[3] - times[2]) / 1000000.0);
+
+            // the frame's passes against its own time between frames, presenting is not counted
+            double frameGpu = (times[3] - times[0]) / 1000000000.0;
+            frameStats.addTime("frame GPU", frameGpu * 1000.0);
+            if (gpuTimestampsInterval[gpuTimestampIndex] > 0.0)
+            {
+                frameStats.addCount("gpu %", frameGpu / gpuTimestampsInterval[gpuTimestampIndex] * 100.0);
+            }
+        }
+    }
+    gpuTimestampsWritten[gpuTimestampIndex] = false;
+    gpuTimestampsPrepass[gpuTimestampIndex] = depthPrepass;
+    gpuTimestampsInterval[gpuTimestampIndex] = 0.0;
+}
+
+void writeGpuTimestamp(int point)
+{
+    glQueryCounter(gpuTimestamps[gpuTimestampIndex][point], GL_TIMESTAMP);
+    gpuTimestampsWritten[gpuTimestampIndex] = point == NUM_GPU_TIMESTAMPS - 1;
+}
+
+// depthOnly draws the lit pass's survivors with the camera depth program, for the prepass
+void setupGpuObjectDraw(int pass, bool depthOnly)
+{
+    if (depthOnly)
+    {
+        GLState::useProgram(depthMultiDrawProgram.getId());
+    }
+    else
+    {
+        GLState::useProgram(pass == SHADOW_PASS ? multiDrawProgram1.getId() : multiDrawProgram2.getId());
+    }
+    GLState::bindVertexArray(meshArena.getVao());
+    GLState::frontFace(GL_CCW);
+    if (pass == LIT_PASS && !depthOnly)
+    {
+        GLState::bindTexture(GL_TEXTURE_2D, 0);
+        bindMaterial(GOLD);
+    }
+}
+
+// the GPU-culled field, the same for every object count: a dispatch, a few binds and one multi-draw
+void submitGpuObjects(int pass, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::mat4& shadowMatrix, bool depthOnly)
+{
+    if (gpuCuller.getNumObjects() == 0)
+    {
+        return;
+    }
+
+    ScopedTimer timer(frameStats, "gpu cull submit");
+    gpuCuller.cull(pass, Frustum::fromMatrix(projectionMatrix * viewMatrix), shadowMatrix, pass == LIT_PASS);
+    setupGpuObjectDraw(pass, depthOnly);
+    gpuCuller.draw(pass, OBJECT_STORAGE_BINDING);
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[14]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW);
-        // --- dolphin shadowing ----
-    shadowMVP = lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // --------------------------
-    glDrawArrays(GL_TRIANGLES, 0, myDolphin.getNumVertices());
+// the lit pass of the GPU-culled field with occlusion culling:
+// whatever last frame's pyramid shows is drawn first, then the pyramid is rebuilt from that depth and the rest retested
+// in the depth prepass no fragment count is running yet, so there is none to pause around the build
+void submitGpuObjectsOccluded(const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix, const glm::mat4& shadowMatrix, bool depthOnly)
+{
+    if (gpuCuller.getNumObjects() == 0)
+    {
+        return;
+    }
 
-    trfmStack.pop(); // ++ remove dolphin's transformations
-    // ------------------------------------------------------------------------------------
+    glm::mat4 viewProjection = projectionMatrix * viewMatrix;
+    {
+        ScopedTimer timer(frameStats, "gpu cull submit");
+        gpuCuller.cullEarly(LIT_PASS, Frustum::fromMatrix(viewProjection), viewProjection, shadowMatrix, hiZ);
+        setupGpuObjectDraw(LIT_PASS, depthOnly);
+        gpuCuller.draw(LIT_PASS, OBJECT_STORAGE_BINDING);
+    }
+    {
+        ScopedTimer timer(frameStats, "hi-z build");
+        if (!depthOnly)
+        {
+            pauseFragmentQuery();
+        }
+        hiZ.build();
+        if (!depthOnly)
+        {
+            resumeFragmentQuery();
+        }
+    }
+    {
+        ScopedTimer timer(frameStats, "gpu cull late");
+        gpuCuller.cullLate(viewProjection, shadowMatrix, hiZ);
+        setupGpuObjectDraw(LIT_PASS, depthOnly);
+        gpuCuller.drawLate(OBJECT_STORAGE_BINDING);
+    }
+}
 
-    trfmStack.pop(); // + remove sun's translation
-    trfmStack.pop(); // remove initial matrix
+// shades the survivors the depth prepass left in the field's buffers, the culling and the depth are done
+void redrawGpuObjects(bool occluded)
+{
+    if (gpuCuller.getNumObjects() == 0)
+    {
+        return;
+    }
 
+    ScopedTimer timer(frameStats, "gpu cull submit");
+    setupGpuObjectDraw(LIT_PASS, false);
+    gpuCuller.draw(LIT_PASS, OBJECT_STORAGE_BINDING);
+    if (occluded)
+    {
+        gpuCuller.drawLate(OBJECT_STORAGE_BINDING);
+    }
 }
 
-void passTwo(GLFWwindow* window, double currentTime)
+// the shadow map lookup of the lit pass, biased from clip space into texture coordinates
+glm::mat4 litShadowMatrix(const FramePacket& packet)
 {
-    glUseProgram(renderingProgram2);
+    return b * packet.lightPmatrix * packet.lightVmatrix;
+}
 
+void passOne(GLFWwindow* window, FramePacket& packet)
+{
     glClear(GL_DEPTH_BUFFER_BIT);
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
-
-    // reference uniform variables
-    mLoc = glGetUniformLocation(renderingProgram2, "m_matrix");
-    vLoc = glGetUniformLocation(renderingProgram2, "v_matrix");
-    pLoc = glGetUniformLocation(renderingProgram2, "p_matrix");
-    nLoc = glGetUniformLocation(renderingProgram2, "n_matrix");
-    shLoc = glGetUniformLocation(renderingProgram2, "sh_mvp_matrix");
-    winSizeLoc = glGetUniformLocation(renderingProgram2, "windowSize");
-
-    // copy perspective matrix
-    glUniformMatrix4fv(pLoc, 1, GL_FALSE, glm::value_ptr(pMat));
-
-    // build and copy view matrix
-    vMat = glm::translate(glm::mat4(1.0f), glm::vec3(-cameraX, -cameraY, -cameraZ));
-    glUniformMatrix4fv(vLoc, 1, GL_FALSE, glm::value_ptr(vMat));
+	GLState::enable(GL_CULL_FACE);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::depthFunc(GL_LEQUAL); // passes if the incoming depth value is less than or equal to the stored depth value
 
-    // copy window size
-    glUniform2f(winSizeLoc, (float)width, (float)height);
+    // every object casts a shadow, drawn from the light's point of view
+    submitPass(packet, SHADOW_PASS);
+    submitGpuObjects(SHADOW_PASS, packet.lightVmatrix, packet.lightPmatrix, packet.lightPmatrix * packet.lightVmatrix, false);
+}
 
-    // set up lights based on the current light's position
-    currLightPos = glm::vec3(initLightPos);
-    installLights(renderingProgram2);
-
-    trfmStack.push(glm::mat4(1.0f)); // + initial matrix
-
-    // ---------------------- pyramid == sun --------------------------------------------
-    trfmStack.push(trfmStack.top()); // ++ copy default matrix
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f)); // sun position
-    trfmStack.push(trfmStack.top()); // +++ push another transform because we want child objects to be relative to the translation above
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(1.0f, 0.0f, 0.0f)); // sun rotation
-    mMat = trfmStack.top();
-    glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(mMat));
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[1]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW); // the pyramid vertices have counter-clockwise winding order
-        // --- pyramid texturing ---
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[2]);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(1);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, brickTexture);
-        // -------------------------
-        // --- pyramid lighting ---
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[13]);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(2);
-    invTrMat = glm::transpose(glm::inverse(mMat));
-    glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-        // ------------------------
-	    // --- pyramid shadowing ---
-    shadowMVP = b * lightPmatrix * lightVmatrix * mMat;
-	glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // -------------------------
-    glDrawArrays(GL_TRIANGLES, 0, 18); // draw the sun
-    trfmStack.pop(); // ++ sun's axial rotation removed
-    // ----------------------------------------------------------------------------------
+// the camera depth of the queued objects and the GPU-culled field, with the same positions as the lit pass and no color
+// the field is culled here for the lit pass, which then only shades the survivors
+void depthPass(GLFWwindow* window, FramePacket& packet)
+{
+    glClear(GL_DEPTH_BUFFER_BIT);
+    GLState::enable(GL_CULL_FACE);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::depthFunc(GL_LEQUAL);
+    GLState::colorMask(GL_FALSE);
+
+    packet.queue.executeDepth(LIT_PASS);
+    frameStats.addCount("prepass draws", packet.queue.getNumDraws());
+    if (packet.occlusionCulling)
+    {
+        submitGpuObjectsOccluded(packet.vMat, packet.pMat, litShadowMatrix(packet), true);
+    }
+    else
+    {
+        submitGpuObjects(LIT_PASS, packet.vMat, packet.pMat, litShadowMatrix(packet), true);
+    }
+    GLState::colorMask(GL_TRUE);
+}
 
-    // ----------------------- cube == planet -------------------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(sin((float)currentTime) * 4.0, 0.0f, cos((float)currentTime) * 4.0));
-    trfmStack.push(trfmStack.top()); // ++++ push another transform because we want child objects to be relative to the translation above
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(0.0, 1.0, 0.0)); // planet rotation
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(0.75f, 0.75f, 0.75f));
-    mMat = trfmStack.top();
-    glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(mMat));
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, cubeStride, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CW); // the cube vertices have clockwise winding order
-        // --- cube texturing ---
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, cubeStride, (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, brickTexture);
-        // ----------------------
-        // --- cube lighting ---
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, cubeStride, (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    invTrMat = glm::transpose(glm::inverse(mMat));
-    glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-        // ---------------------
-        // --- cube shadowing ---
-    shadowMVP = b * lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // -------------------------
-    glDrawArrays(GL_TRIANGLES, 0, 36); // draw the planet
-    trfmStack.pop(); // +++ planet's rotation axis and scaling removed
-
-    // ----------------------- smaller cube == moon -------------------------------------
-    trfmStack.push(trfmStack.top()); // ++++ inherit planet's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, sin((float)currentTime) * 2.0, cos((float)currentTime) * 2.0));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(0.0, 0.0, 1.0)); // moon rotation
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(0.25f, 0.25f, 0.25f)); // make the moon smaller
-    mMat = trfmStack.top();
-    glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(mMat));
-
-    // recalculate inverse-transpose of M matrix
-    invTrMat = glm::transpose(glm::inverse(mMat));
-    glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[0]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, cubeStride, 0);
-    glEnableVertexAttribArray(0);
-    glBindTexture(GL_TEXTURE_2D, 0); // unbind texture
-    glDrawArrays(GL_TRIANGLES, 0, 36); // draw the moon
-
-    trfmStack.pop(); // +++ remove moon's transformations
-    trfmStack.pop(); // ++ remove planet's translation
-    // ----------------------------------------------------------------------------------
+void passTwo(GLFWwindow* window, FramePacket& packet)
+{
+    // after the depth prepass, only the fragments whose depth it kept are shaded
+    if (!depthPrepass)
+    {
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+    GLState::enable(GL_CULL_FACE);
+    GLState::enable(GL_DEPTH_TEST);
+    GLState::depthFunc(depthPrepass ? GL_EQUAL : GL_LEQUAL);
+    GLState::depthMask(depthPrepass ? GL_FALSE : GL_TRUE);
+
+    // the queued objects are drawn first and are the occluders, only the GPU-culled field is tested against them
+    submitPass(packet, LIT_PASS);
+    if (depthPrepass)
+    {
+        redrawGpuObjects(packet.occlusionCulling);
+    }
+    else if (packet.occlusionCulling)
+    {
+        submitGpuObjectsOccluded(packet.vMat, packet.pMat, litShadowMatrix(packet), false);
+    }
+    else
+    {
+        submitGpuObjects(LIT_PASS, packet.vMat, packet.pMat, litShadowMatrix(packet), false);
+    }
+    GLState::depthFunc(GL_LEQUAL);
+    GLState::depthMask(GL_TRUE);
+}
 
-    // ------------------------------ procedural sphere ---------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(-2.0f, 0.0f, 0.0f));
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(0.0f, 1.0f, 0.0f));
-    mMat = trfmStack.top();
-    glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(mMat));
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[3]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW); // the sphere vertices have clockwise winding order
-	    // --- sphere texturing ---
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[4]);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0); // specify layout of tex coords
-    glEnableVertexAttribArray(1); // enable vert shader to access tex coords stored in VBO
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, earthTexture);
-        // ------------------------
-        // --- sphere lighting ---
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[5]);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(2);
-    invTrMat = glm::transpose(glm::inverse(mMat));
-    glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-        // -----------------------
-        // --- sphere shadowing ---
-    shadowMVP = b * lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // ------------------------
-    glDrawArrays(GL_TRIANGLES, 0, mySphere.getNumIndices());
-
-    trfmStack.pop(); // ++ remove sphere's transformations
-    // ----------------------------------------------------------------------------------
+void postUpdateCommand(const std::function<void()>& command)
+{
+    std::lock_guard<std::mutex> lock(updateCommandMutex);
+    updateCommands.push_back(command);
+}
 
-    // ------------------------------ procedural torus ----------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(2.0f, 0.0f, 0.0f));
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(2.0f, 2.0f, 2.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), Utils::toRadians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(0.0f, -1.0, 0.0f));
-    mMat = trfmStack.top();
-    glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(mMat));
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[6]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW);
-        // --- torus texturing ---
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[7]);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(1);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, brickTexture);
-        // -----------------------
-        // --- torus lighting ---
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[8]);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(2);
-    invTrMat = glm::transpose(glm::inverse(mMat));
-    glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-        // ----------------------
-        // --- torus shadowing ---
-    shadowMVP = b * lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // -------------------------
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vbo[9]);
-    glDrawElements(GL_TRIANGLES, myTorus.getNumIndices(), GL_UNSIGNED_INT, 0);
-
-    trfmStack.pop(); // ++ remove torus's transformations
-    // ----------------------------------------------------------------------------------
+void runUpdateCommands()
+{
+    std::vector<std::function<void()>> commands;
+    {
+        std::lock_guard<std::mutex> lock(updateCommandMutex);
+        commands.swap(updateCommands);
+    }
+    for (const std::function<void()>& command : commands)
+    {
+        command();
+    }
+}
+
+void stepSimulation(FramePacket& packet)
+{
+    {
+        ScopedTimer timer(packet.stats, "animation");
+        animation.evaluate(simulationTime, sceneGraph, jobSystem);
+    }
+    {
+        ScopedTimer timer(packet.stats, "transforms");
+        sceneGraph.update();
+    }
+}
 
-    // ------------------------------- imported shuttle -----------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(cos((float)currentTime) * 4.0f, sin((float)currentTime) * 4.0f, cos((float)currentTime) * 4.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), (float)currentTime, glm::vec3(1.0, 1.0, 0.0));
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(4.0f, 4.0f, 4.0f));
-    mMat = trfmStack.top();
-    glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(mMat));
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[10]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW);
-        // --- shuttle texturing ---
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[11]);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(1);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, shuttleTexture);
-        // ------------------------
-        // --- shuttle lighting ---
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[12]);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(2);
-    invTrMat = glm::transpose(glm::inverse(mMat));
-    glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-        // ------------------------
-        // --- shuttle shadowing ---
-    shadowMVP = b * lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // -------------------------
-    glDrawArrays(GL_TRIANGLES, 0, myShuttle.getNumVertices());
-
-    trfmStack.pop(); // ++ remove shuttle's transformations
-    // ------------------------------------------------------------------------------------
-
-    // ------------------------------- imported dolphin -----------------------------------
-    trfmStack.push(trfmStack.top()); // +++ inherit sun's translation
-    trfmStack.top() *= glm::translate(glm::mat4(1.0f), glm::vec3(cos((float)currentTime) * 4.0f, -sin((float)currentTime) * 4.0f, -cos((float)currentTime) * 4.0f));
-    trfmStack.top() *= glm::rotate(glm::mat4(1.0f), -(float)currentTime, glm::vec3(1.0, 1.0, 0.0));
-    trfmStack.top() *= glm::scale(glm::mat4(1.0f), glm::vec3(4.0f, 4.0f, 4.0f));
-    mMat = trfmStack.top();
-    glUniformMatrix4fv(mLoc, 1, GL_FALSE, glm::value_ptr(mMat));
-
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[14]);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(0);
-    glFrontFace(GL_CCW);
-        // --- dolphin texturing ---
-    glBindTexture(GL_TEXTURE_2D, 0);
-        // ------------------------
-        // --- dolphin lighting ---
-    glBindBuffer(GL_ARRAY_BUFFER, vbo[16]);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(2);
-    invTrMat = glm::transpose(glm::inverse(mMat));
-    glUniformMatrix4fv(nLoc, 1, GL_FALSE, glm::value_ptr(invTrMat));
-        // ------------------------
-        // --- dolphin shadowing ---
-    shadowMVP = b * lightPmatrix * lightVmatrix * mMat;
-    glUniformMatrix4fv(shLoc, 1, GL_FALSE, glm::value_ptr(shadowMVP));
-        // -------------------------
-    glDrawArrays(GL_TRIANGLES, 0, myDolphin.getNumVertices());
-
-    trfmStack.pop(); // ++ remove dolphin's transformations
-    // ------------------------------------------------------------------------------------
-
-    trfmStack.pop(); // + remove sun's translation
-    trfmStack.pop(); // remove initial matrix
-}
-
-void display(GLFWwindow* window, double currentTime)
+// seconds since GLFW started, or in headless runs a clock that advances HEADLESS_FRAME_TIME per updated frame
+double getTime()
+{
+    return headless ? headlessClock.load() : glfwGetTime();
+}
+
+// advances the scene by whole steps for the clock time that passed, and blends its last two steps for both passes
+// a step depends on nothing but its time, so a given sequence of steps replays the same whatever the frame rate
+void simulate(FramePacket& packet)
+{
+    double clock = getTime();
+    double step = 1.0 / simulationRate;
+    int numSteps = 0;
+    if (simulationTime < 0.0)
+    {
+        simulationTime = clock;
+        previousSimulationTime = clock;
+        stepSimulation(packet);
+        numSteps++;
+    }
+    else
+    {
+        simulationAccumulator += clock - lastSimulationClock;
+        while (simulationAccumulator >= step && numSteps < MAX_SIMULATION_STEPS)
+        {
+            sceneGraph.storePrevious();
+            previousSimulationTime = simulationTime;
+            simulationTime += step;
+            stepSimulation(packet);
+            simulationAccumulator -= step;
+            numSteps++;
+        }
+        if (simulationAccumulator >= step)
+        {
+            // under load the steps left over are dropped rather than run next frame, which would only be slower
+            double dropped = std::floor(simulationAccumulator / step);
+            simulationAccumulator -= dropped * step;
+            packet.stats.addCount("steps dropped", dropped);
+        }
+    }
+    lastSimulationClock = clock;
+    packet.stats.addCount("steps", numSteps);
+
+    float alpha = (float)(simulationAccumulator / step);
+    {
+        ScopedTimer timer(packet.stats, "interpolation");
+        sceneGraph.interpolate(alpha, jobSystem);
+    }
+    packet.time = previousSimulationTime + (simulationTime - previousSimulationTime) * alpha;
+}
+
+// everything of a frame that does not need the GL context, on the update thread
+void updateFrame(FramePacket& packet)
+{
+    packet.start = std::chrono::steady_clock::now();
+    runUpdateCommands();
+
+    // world transforms for both passes
+    simulate(packet);
+    buildRenderQueue(packet.queue);
+    {
+        ScopedTimer timer(packet.stats, "bounds");
+        packet.queue.computeBounds(sceneGraph);
+    }
+    packet.stats.addCount("nodes", sceneGraph.getNumNodes());
+    packet.stats.addCount("updated", sceneGraph.getNumUpdated());
+
+    // the camera, and the view and perspective matrix from the light point of view, for pass 1
+    vMat = glm::translate(glm::mat4(1.0f), glm::vec3(-cameraX, -cameraY, -cameraZ));
+    lightVmatrix = glm::lookAt(initLightPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)); // vector from light to origin
+    lightPmatrix = glm::perspective(1.0472f, aspect, 0.1f, 1000.0f);
+
+    // normal and shadow matrices of every queued object, spread over the job system's threads
+    {
+        ScopedTimer timer(packet.stats, "object data");
+        glm::mat4 shadowMatrices[NUM_RENDER_PASSES] = { lightPmatrix * lightVmatrix, b * lightPmatrix * lightVmatrix };
+        packet.queue.computeObjects(sceneGraph, shadowMatrices, jobSystem);
+    }
+    preparePass(packet, SHADOW_PASS, lightVmatrix, lightPmatrix);
+    preparePass(packet, LIT_PASS, vMat, pMat);
+
+    packet.vMat = vMat;
+    packet.pMat = pMat;
+    packet.lightVmatrix = lightVmatrix;
+    packet.lightPmatrix = lightPmatrix;
+    packet.lightPos = initLightPos;
+    packet.beltCount = beltCount;
+    packet.gpuObjectCount = gpuObjectCount;
+    packet.occlusionCulling = occlusionCulling;
+    packet.animateTorus = animateTorus;
+    if (headless)
+    {
+        headlessClock = headlessClock + HEADLESS_FRAME_TIME;
+    }
+}
+
+// fills packets until the mailbox is closed, at most one frame ahead of the one being drawn
+void updateLoop()
+{
+    while (true)
+    {
+        auto waitStart = std::chrono::steady_clock::now();
+        int slot = frameMailbox.beginWrite();
+        if (slot < 0)
+        {
+            return;
+        }
+        FramePacket& packet = framePackets[slot];
+        packet.stats.clear();
+        std::chrono::duration<double, std::milli> waited = std::chrono::steady_clock::now() - waitStart;
+        packet.stats.addTime("render wait", waited.count());
+        {
+            ScopedTimer timer(packet.stats, "update");
+            updateFrame(packet);
+        }
+        frameMailbox.publish(slot);
+    }
+}
+
+void display(GLFWwindow* window, FramePacket& packet)
 {
     glClear(GL_DEPTH_BUFFER_BIT);
     glClear(GL_COLOR_BUFFER_BIT);
 
-    // set up view and perspective matrix from the light point of view, for pass 1
-    lightVmatrix = glm::lookAt(currLightPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)); // vector from light to origin
-    lightPmatrix = glm::perspective(1.0472f, aspect, 0.1f, 1000.0f);
+    // the buffers sized by the update thread's choices are rebuilt here, they are GL objects
+    if (beltInstances.getCount() != packet.beltCount)
+    {
+        setBeltSize(packet.beltCount);
+    }
+    if (gpuCuller.getNumObjects() != packet.gpuObjectCount)
+    {
+        setGpuObjects(packet.gpuObjectCount);
+    }
+
+    // waits until the GPU is done with the region written 3 frames ago
+    streamBuffer.beginFrame();
+
+    if (packet.animateTorus)
+    {
+        if (!meshGeneratorValidated)
+        {
+            meshGenerator.validate();
+            meshGeneratorValidated = true;
+        }
+
+        // deform the torus on the GPU, its vertices never travel through the CPU
+        float innerRadius = 0.5f + 0.1f * (float)sin(packet.time);
+        float outerRadius = 0.2f + 0.05f * (float)cos(packet.time * 1.3);
+        meshGenerator.generateTorus(animatedTorus, innerRadius, outerRadius, 48);
+    }
 
     // make the custom frame buffer current, and associate it with the shadow texture
     glBindFramebuffer(GL_FRAMEBUFFER, shadowBuffer);
@@ -851,32 +1180,583 @@ void display(GLFWwindow* window, double currentTime)
     // disable drawing colors
     glDrawBuffer(GL_NONE);
 
-    passOne(window, currentTime);
+    beginGpuTimestamps();
+    writeGpuTimestamp(0);
+    passOne(window, packet);
+    writeGpuTimestamp(1);
+
+    // restore the display buffer, and re-enable drawing
+    glBindFramebuffer(GL_FRAMEBUFFER, headless ? offscreenTarget.getFramebuffer() : 0);
+    GLState::activeTexture(GL_TEXTURE1);
+    GLState::bindTexture(GL_TEXTURE_2D, shadowTex);
+    glDrawBuffer(headless ? GL_COLOR_ATTACHMENT0 : GL_FRONT); // re-enables drawing colors
 
-    // restore the default display buffer, and re-enable drawing
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, shadowTex);
-    glDrawBuffer(GL_FRONT); // re-enables drawing colors
+    // copy the camera's matrices and the window size
+    frameData.pMatrix = packet.pMat;
+    frameData.vMatrix = packet.vMat;
+    frameData.windowSize = glm::vec2((float)width, (float)height);
 
-    passTwo(window, currentTime);
+    // set up lights based on the current light's position
+    currLightPos = packet.lightPos;
+    installLights();
+    uploadFrameData();
+
+    if (depthPrepass)
+    {
+        depthPass(window, packet);
+    }
+    writeGpuTimestamp(2);
+
+    beginFragmentQuery();
+    passTwo(window, packet);
+    endFragmentQuery();
+    writeGpuTimestamp(3);
+
+    streamBuffer.endFrame();
+    frameStats.addTime("fence wait", streamBuffer.getFenceWaitTime());
+    frameStats.addCount("streamed KB", streamBuffer.getBytesStreamed() / 1024.0);
+}
+
+// after the swap: the latency is the time from the start of the packet's update until its frame was handed over,
+// what the pipelining adds to it is the update time and the render wait
+void endFrame(FramePacket& packet)
+{
+    std::chrono::duration<double, std::milli> latency = std::chrono::steady_clock::now() - packet.start;
+    frameStats.addTime("latency", latency.count());
+    frameStats.merge(packet.stats);
+
+    // GL calls of every kind that reached the driver, and the ones dropped because they would not change anything
+    for (int category = 0; category < GLState::NUM_CATEGORIES; category++)
+    {
+        frameStats.addCount(GLState::getIssuedName((GLState::Category)category), GLState::getNumIssued((GLState::Category)category));
+        frameStats.addCount(GLState::getFilteredName((GLState::Category)category), GLState::getNumFiltered((GLState::Category)category));
+    }
+    GLState::resetCounters();
+
+    if (framePacer.getFrameInterval() > 0.0)
+    {
+        frameStats.addTime("frame", framePacer.getFrameInterval() * 1000.0);
+    }
+    gpuTimestampsInterval[gpuTimestampIndex] = framePacer.getFrameInterval();
+    frameStats.endFrame(getTime());
+}
+
+// in render-on-demand mode, draws until a frame updated after the request is on screen: the packet waiting in the
+// mailbox was made before it
+void requestRedraw()
+{
+    pendingRedraws = FrameMailbox::NUM_SLOTS;
+}
+
+void window_refresh_callback(GLFWwindow* window)
+{
+    requestRedraw();
 }
 
 void window_reshape_callback(GLFWwindow* window, int newWidth, int newHeight)
 {
+    requestRedraw();
     width = newWidth;
     height = newHeight;
-
-    aspect = (float)width / (float)height;
     glViewport(0, 0, width, height); // set screen region associated with framebuffer
-    pMat = glm::perspective(1.0472f, aspect, 0.1f, 1000.0f); // update perspective matrix, 1.0472 radians = 60 degrees
 
-    glBindTexture(GL_TEXTURE_2D, shadowTex);
+    // the projections are the update thread's
+    postUpdateCommand([newWidth, newHeight] {
+        aspect = (float)newWidth / (float)newHeight;
+        pMat = glm::perspective(1.0472f, aspect, 0.1f, 1000.0f); // update perspective matrix, 1.0472 radians = 60 degrees
+    });
+
+    GLState::bindTexture(GL_TEXTURE_2D, shadowTex);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0); // update shadow size
+    hiZ.resize(width, height);
+}
+
+// times computeObjects() on a million objects for every thread count up to the number of cores
+void benchmarkObjectData()
+{
+    const int numObjects = 1000000;
+    TransformHierarchy transforms;
+    RenderQueue queue;
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> angle(0.0f, 6.2832f);
+    for (int i = 0; i < numObjects; i++)
+    {
+        Transform local = Transform::fromAxisAngle(glm::vec3(position(random), position(random), position(random)), angle(random), glm::vec3(1.0f, 2.0f, 3.0f));
+        queue.add({ ALL_PASSES, { &cubeMesh, &cubeMesh }, 0, GOLD, GL_CCW, transforms.addNode(-1, local), 0 });
+    }
+    transforms.update();
+    glm::mat4 shadowMatrices[NUM_RENDER_PASSES] = { lightPmatrix * lightVmatrix, b * lightPmatrix * lightVmatrix };
+
+    int previousThreads = jobSystem.getNumThreads();
+    int maxThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+    double singleThreadTime = 0.0;
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads++)
+    {
+        jobSystem.start(numThreads);
+        queue.computeObjects(transforms, shadowMatrices, jobSystem); // first touch of the output
+
+        // best of a few runs, the others mostly measure the rest of the system
+        double best = 1e30;
+        for (int run = 0; run < 5; run++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            queue.computeObjects(transforms, shadowMatrices, jobSystem);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        singleThreadTime = numThreads == 1 ? best : singleThreadTime;
+        std::cout << "object data, " << numObjects << " objects, " << numThreads << " threads: " << best << " ms, "
+            << singleThreadTime / best << "x" << std::endl;
+    }
+    jobSystem.start(previousThreads);
+
+    // what the compact transform saves, the hierarchy keeps a local and a world per node
+    const double megabytesPerMillion = 1000000.0 / (1024.0 * 1024.0);
+    std::cout << "per million nodes: hierarchy " << 2 * sizeof(Transform) * megabytesPerMillion << " MB (mat4 "
+        << 2 * sizeof(glm::mat4) * megabytesPerMillion << " MB), object data upload " << sizeof(ObjectData) * megabytesPerMillion
+        << " MB per pass (mat4 " << 3 * sizeof(glm::mat4) * megabytesPerMillion << " MB)" << std::endl;
 }
 
-int main(void)
+// times recording 100k draws of mixed state for every thread count up to the number of cores
+void benchmarkRecording()
 {
+    const int numDraws = 100000;
+    const Mesh* meshes[] = { &cubeMesh, &pyramidMesh, &sphereMesh, &torusMesh, &beltMesh };
+    const GLuint textures[] = { 0, brickTexture, earthTexture };
+    TransformHierarchy transforms;
+    RenderQueue& queue = recordingQueue;
+    queue.clear();
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-10.0f, 10.0f);
+    for (int i = 0; i < numDraws; i++)
+    {
+        // mostly arena meshes merged into multi-draws, with the belt cube as a single draw every few items
+        const Mesh* mesh = meshes[random() % 5];
+        int node = transforms.addNode(-1, Transform(glm::vec3(position(random), position(random), position(random) - 20.0f)));
+        queue.add({ ALL_PASSES, { mesh, mesh }, textures[random() % 3], (int)(random() % NUM_MATERIALS), GL_CCW, node, 0 });
+    }
+    transforms.update();
+    glm::mat4 shadowMatrices[NUM_RENDER_PASSES] = { glm::mat4(1.0f), glm::mat4(1.0f) };
+    queue.computeBounds(transforms);
+    queue.computeObjects(transforms, shadowMatrices, jobSystem);
+    queue.cull(LIT_PASS, Frustum::fromMatrix(glm::perspective(3.0f, 1.0f, 0.1f, 1000.0f)));
+    queue.sort(LIT_PASS, glm::mat4(1.0f), transforms);
+
+    int previousThreads = jobSystem.getNumThreads();
+    int maxThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+    double singleThreadTime = 0.0;
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads++)
+    {
+        jobSystem.start(numThreads);
+        queue.record(LIT_PASS, jobSystem); // first touch of the command lists
+
+        double best = 1e30;
+        for (int run = 0; run < 5; run++)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            queue.record(LIT_PASS, jobSystem);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+            best = std::min(best, elapsed.count());
+        }
+        singleThreadTime = numThreads == 1 ? best : singleThreadTime;
+        std::cout << "command recording, " << numDraws << " draws, " << numThreads << " threads: " << best << " ms, "
+            << singleThreadTime / best << "x" << std::endl;
+    }
+    jobSystem.start(previousThreads);
+}
+
+// times the matrix kernels against glm on a million transforms, and checks that they agree within tolerance
+// the same few thousand matrices are reused so that the timings measure arithmetic rather than memory bandwidth
+void benchmarkMatrixMath()
+{
+    const int count = 4096;
+    const int repeats = 244;
+    std::vector<glm::mat4> a(count), rhs(count), out(count), reference(count);
+    std::vector<glm::vec3> translations(count), axes(count), scales(count);
+    std::vector<float> angles(count);
+    std::mt19937 random(4321);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> positive(0.1f, 4.0f);
+    for (int i = 0; i < count; i++)
+    {
+        // every other transform has a uniform scale, like most of the scene
+        translations[i] = glm::vec3(unit(random), unit(random), unit(random)) * 100.0f;
+        axes[i] = glm::vec3(unit(random), unit(random), unit(random) + 2.0f);
+        angles[i] = unit(random) * 3.1416f;
+        float uniformScale = positive(random);
+        scales[i] = (i % 2 == 0) ? glm::vec3(uniformScale) : glm::vec3(positive(random), positive(random), positive(random));
+        a[i] = glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), translations[i]), angles[i], axes[i]), scales[i]);
+        rhs[i] = glm::rotate(glm::mat4(1.0f), unit(random), glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+
+    // largest difference relative to the largest element of the reference matrix
+    auto maxError = [&]()
+    {
+        double worst = 0.0;
+        for (int i = 0; i < count; i++)
+        {
+            float largest = 0.0f;
+            float difference = 0.0f;
+            for (int c = 0; c < 4; c++)
+            {
+                for (int r = 0; r < 4; r++)
+                {
+                    largest = std::max(largest, fabsf(reference[i][c][r]));
+                    difference = std::max(difference, fabsf(reference[i][c][r] - out[i][c][r]));
+                }
+            }
+            worst = std::max(worst, (double)(difference / std::max(largest, 1e-30f)));
+        }
+        return worst;
+    };
+    auto time = [&](const std::function<void()>& body)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int repeat = 0; repeat < repeats; repeat++)
+        {
+            body();
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count();
+    };
+    auto report = [&](const char* name, double glmTime, double kernelTime, double tolerance)
+    {
+        double error = maxError();
+        std::cout << name << ": glm " << glmTime << " ms, kernel " << kernelTime << " ms, " << glmTime / kernelTime
+            << "x, max relative error " << error << (error <= tolerance ? " ok" : " FAILED") << std::endl;
+    };
+
+    double glmTime = time([&] { for (int i = 0; i < count; i++) reference[i] = a[i] * rhs[i]; });
+    double kernelTime = time([&] { MatrixMath::multiplyBatch(&a[0], &rhs[0], &out[0], count); });
+    report("multiply", glmTime, kernelTime, 1e-6);
+
+    glmTime = time([&] { for (int i = 0; i < count; i++) reference[i] = glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), translations[i]), angles[i], axes[i]), scales[i]); });
+    kernelTime = time([&] { for (int i = 0; i < count; i++) out[i] = MatrixMath::composeTRS(translations[i], angles[i], axes[i], scales[i]); });
+    report("compose TRS", glmTime, kernelTime, 1e-6);
+
+    glmTime = time([&] { for (int i = 0; i < count; i++) reference[i] = glm::transpose(glm::inverse(a[i])); });
+    kernelTime = time([&] { for (int i = 0; i < count; i++) out[i] = MatrixMath::normalMatrix(a[i]); });
+    report("normal matrix", glmTime, kernelTime, 1e-4);
+    kernelTime = time([&] { MatrixMath::normalMatrixBatch(&a[0], &out[0], count); });
+    report("normal matrix, batch of 4", glmTime, kernelTime, 1e-4);
+
+    glmTime = time([&] { for (int i = 0; i < count; i++) reference[i] = glm::inverse(a[i]); });
+    kernelTime = time([&] { for (int i = 0; i < count; i++) out[i] = MatrixMath::affineInverse(a[i]); });
+    report("affine inverse", glmTime, kernelTime, 1e-4);
+
+    // the compact transform against the matrices it replaces, with the uniform scales the scene graph is limited to
+    std::vector<Transform> parents(count), children(count), results(count);
+    std::vector<glm::mat4> parentMatrices(count);
+    for (int i = 0; i < count; i++)
+    {
+        parents[i] = Transform::fromAxisAngle(translations[i], angles[i], axes[i], scales[i].x);
+        children[i] = Transform(glm::vec3(rhs[i][3]), glm::quat_cast(glm::mat3(rhs[i])));
+        parentMatrices[i] = parents[i].toMatrix();
+    }
+    auto toMatrices = [&]()
+    {
+        for (int i = 0; i < count; i++)
+        {
+            out[i] = results[i].toMatrix();
+        }
+    };
+    glmTime = time([&] { for (int i = 0; i < count; i++) reference[i] = parentMatrices[i] * rhs[i]; });
+    kernelTime = time([&] { for (int i = 0; i < count; i++) results[i] = parents[i] * children[i]; });
+    toMatrices();
+    report("transform compose", glmTime, kernelTime, 1e-5);
+
+    glmTime = time([&] { for (int i = 0; i < count; i++) reference[i] = glm::inverse(parentMatrices[i]); });
+    kernelTime = time([&] { for (int i = 0; i < count; i++) results[i] = parents[i].inverse(); });
+    toMatrices();
+    report("transform inverse", glmTime, kernelTime, 1e-4);
+}
+
+// keys passed on by key_callback(), on the update thread
+void handleKey(int key)
+{
+    if (key == GLFW_KEY_B)
+    {
+        // cycle through the belt sizes
+        int numCounts = sizeof(beltInstanceCounts) / sizeof(beltInstanceCounts[0]);
+        int next = 0;
+        while (next < numCounts && beltInstanceCounts[next] != beltCount)
+        {
+            next++;
+        }
+        beltCount = beltInstanceCounts[(next + 1) % numCounts];
+        std::cout << "belt instances: " << beltCount << std::endl;
+    }
+    else if (key == GLFW_KEY_G)
+    {
+        // cycle through the sizes of the GPU-culled field
+        int numCounts = sizeof(gpuObjectCounts) / sizeof(gpuObjectCounts[0]);
+        int next = 0;
+        while (next < numCounts && gpuObjectCounts[next] != gpuObjectCount)
+        {
+            next++;
+        }
+        gpuObjectCount = gpuObjectCounts[(next + 1) % numCounts];
+        std::cout << "gpu-culled objects: " << gpuObjectCount << std::endl;
+    }
+    else if (key == GLFW_KEY_H)
+    {
+        occlusionCulling = !occlusionCulling;
+        std::cout << "occlusion culling: " << (occlusionCulling ? "on" : "off") << std::endl;
+    }
+    else if (key == GLFW_KEY_A)
+    {
+        animateTorus = !animateTorus;
+        std::cout << "animated torus: " << (animateTorus ? "on" : "off") << std::endl;
+    }
+    else if (key == GLFW_KEY_D)
+    {
+        drawStressNodes = !drawStressNodes;
+        std::cout << "draw transform stress nodes: " << (drawStressNodes ? "on" : "off") << std::endl;
+    }
+    else if (key == GLFW_KEY_J)
+    {
+        benchmarkObjectData();
+    }
+    else if (key == GLFW_KEY_K)
+    {
+        benchmarkMatrixMath();
+    }
+    else if (key == GLFW_KEY_R)
+    {
+        benchmarkRecording();
+    }
+    else if (key == GLFW_KEY_U)
+    {
+        // cycle through the simulation rates
+        int numRates = sizeof(simulationRates) / sizeof(simulationRates[0]);
+        int next = 0;
+        while (next < numRates && simulationRates[next] != simulationRate)
+        {
+            next++;
+        }
+        simulationRate = simulationRates[(next + 1) % numRates];
+        std::cout << "simulation steps per second: " << simulationRate << std::endl;
+    }
+    else if (key == GLFW_KEY_T)
+    {
+        // cycle through the stress node counts
+        int numCounts = sizeof(stressNodeCounts) / sizeof(stressNodeCounts[0]);
+        int next = 0;
+        while (next < numCounts && stressNodeCounts[next] != numStressNodes)
+        {
+            next++;
+        }
+        setStressNodes(stressNodeCounts[(next + 1) % numCounts]);
+        if (simulationTime >= 0.0)
+        {
+            // the new nodes join at the last step, there is no step before to blend with until the next one
+            animation.evaluate(simulationTime, sceneGraph, jobSystem);
+            sceneGraph.update();
+        }
+        std::cout << "transform stress nodes: " << numStressNodes << std::endl;
+    }
+}
+
+// every key but F, S, P, V, L and I changes what the update thread owns, so it is handled there before its next frame
+void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+    {
+        return;
+    }
+    requestRedraw();
+    if (key == GLFW_KEY_F)
+    {
+        frameStats.setEnabled(!frameStats.isEnabled());
+    }
+    else if (key == GLFW_KEY_S)
+    {
+        GLState::setFiltering(!GLState::isFiltering());
+        std::cout << "redundant GL state filtering: " << (GLState::isFiltering() ? "on" : "off") << std::endl;
+    }
+    else if (key == GLFW_KEY_P)
+    {
+        depthPrepass = !depthPrepass;
+        std::cout << "depth prepass: " << (depthPrepass ? "on" : "off") << std::endl;
+    }
+    else if (key == GLFW_KEY_V)
+    {
+        // headless runs have no window to swap, and GLFW is not initialised in them
+        if (!headless)
+        {
+            framePacer.setSwapInterval(framePacer.getSwapInterval() == 0 ? 1 : 0);
+            std::cout << "vsync: " << (framePacer.getSwapInterval() != 0 ? "on" : "off") << std::endl;
+        }
+    }
+    else if (key == GLFW_KEY_L)
+    {
+        // cycle through the frame rate limits
+        int numLimits = sizeof(targetFpsValues) / sizeof(targetFpsValues[0]);
+        int next = 0;
+        while (next < numLimits && targetFpsValues[next] != framePacer.getTargetFps())
+        {
+            next++;
+        }
+        framePacer.setTargetFps(targetFpsValues[(next + 1) % numLimits]);
+        std::cout << "frame rate limit: " << framePacer.getTargetFps() << std::endl;
+    }
+    else if (key == GLFW_KEY_I)
+    {
+        renderOnDemand = !renderOnDemand;
+        std::cout << "render on demand: " << (renderOnDemand ? "on" : "off") << std::endl;
+    }
+    else
+    {
+        postUpdateCommand([key] { handleKey(key); });
+    }
+}
+
+// draws the scene into an offscreen target without a window, for servers without a display or a GPU, and exits:
+//   OpenGLPlayground --headless [--size 800x600] [--frames 100] [--png prefix] [--keys 0:F,0:B,30:P] [--anisotropy 16]
+// keys are pressed before the given frame is drawn, as if typed; the update thread's show a frame or two later,
+// except those of frame 0, which are in from the start; V does nothing, there is no swap chain to synchronise;
+// with --png every frame is written to prefix0000.png, ...
+// --anisotropy overrides the default of textureAnisotropy
+int runHeadless(int argc, char** argv)
+{
+    int targetWidth = SCR_WIDTH;
+    int targetHeight = SCR_HEIGHT;
+    int numFrames = 100;
+    std::string pngPrefix;
+    std::vector<std::pair<int, int>> keys; // frame and GLFW key, which is the upper case letter
+    for (int i = 2; i < argc; i += 2)
+    {
+        std::string option = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        bool valid = true;
+        if (option == "--size")
+        {
+            valid = sscanf(value, "%dx%d", &targetWidth, &targetHeight) == 2 && targetWidth > 0 && targetHeight > 0;
+        }
+        else if (option == "--frames")
+        {
+            numFrames = atoi(value);
+            valid = numFrames > 0;
+        }
+        else if (option == "--png")
+        {
+            pngPrefix = value;
+            valid = !pngPrefix.empty();
+        }
+        else if (option == "--anisotropy")
+        {
+            textureAnisotropy = (float)atof(value);
+            valid = textureAnisotropy >= 1.0f;
+        }
+        else if (option == "--keys")
+        {
+            std::stringstream list(value);
+            std::string entry;
+            while (std::getline(list, entry, ','))
+            {
+                int frame;
+                char key;
+                if (sscanf(entry.c_str(), "%d:%c", &frame, &key) != 2)
+                {
+                    valid = false;
+                    break;
+                }
+                keys.push_back({ frame, toupper(key) });
+            }
+        }
+        else
+        {
+            valid = false;
+        }
+        if (!valid)
+        {
+            std::cout << "usage: --headless [--size 800x600] [--frames 100] [--png prefix] [--keys 0:F,0:B,30:P] [--anisotropy 16]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    HeadlessContext context;
+    if (!context.create())
+    {
+        return EXIT_FAILURE;
+    }
+    if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress))
+    {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return EXIT_FAILURE;
+    }
+    Utils::setGLLoader((GLADloadproc)HeadlessContext::getProcAddress);
+    std::cout << "headless: " << context.getPlatformName() << ", " << glGetString(GL_RENDERER) << ", "
+        << targetWidth << "x" << targetHeight << std::endl;
+
+    headless = true;
+    if (!offscreenTarget.init(targetWidth, targetHeight))
+    {
+        std::cout << "offscreen framebuffer incomplete" << std::endl;
+        return EXIT_FAILURE;
+    }
+    glViewport(0, 0, targetWidth, targetHeight); // a context without a surface starts with an empty viewport
+    init(nullptr);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreenTarget.getFramebuffer());
+
+    auto pressKeys = [&keys](int frame) {
+        for (const std::pair<int, int>& key : keys)
+        {
+            if (key.first == frame)
+            {
+                key_callback(nullptr, key.second, 0, GLFW_PRESS, 0);
+            }
+        }
+    };
+    pressKeys(0);
+    updateThread = std::thread(updateLoop);
+
+    for (int frame = 0; frame < numFrames; frame++)
+    {
+        if (frame > 0)
+        {
+            pressKeys(frame);
+        }
+        int slot;
+        {
+            ScopedTimer timer(frameStats, "update wait");
+            while ((slot = frameMailbox.acquire(0.1)) < 0)
+            {
+            }
+        }
+        FramePacket& packet = framePackets[slot];
+        {
+            ScopedTimer timer(frameStats, "render");
+            display(nullptr, packet);
+        }
+        if (!pngPrefix.empty())
+        {
+            char number[16];
+            snprintf(number, sizeof(number), "%04d.png", frame);
+            if (!offscreenTarget.savePng(pngPrefix + number))
+            {
+                std::cout << "could not write " << pngPrefix + number << std::endl;
+            }
+        }
+        framePacer.endFrame(frameStats);
+        endFrame(packet);
+    }
+    glFinish();
+
+    frameMailbox.close();
+    updateThread.join();
+    context.destroy();
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+    {
+        return runHeadless(argc, argv);
+    }
+
     if (!glfwInit())
     {
         exit(EXIT_FAILURE);
@@ -901,15 +1781,49 @@ int main(void)
     }
 
     glfwSetWindowSizeCallback(window, window_reshape_callback);
+    glfwSetKeyCallback(window, key_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
+    framePacer.setSwapInterval(1);
     init(window);
+    updateThread = std::thread(updateLoop);
 
     while (!glfwWindowShouldClose(window))
     {
-        display(window, glfwGetTime());
-        glfwSwapBuffers(window);
+        // nothing to draw: sleeps until input or the window needs a redraw, and the update thread stops too once
+        // the mailbox is full; the animation is not a change, it goes on from where it stood, at most a few steps later,
+        // and the rest of the idle time is dropped
+        if (renderOnDemand && pendingRedraws == 0)
+        {
+            glfwWaitEvents();
+            continue;
+        }
+
+        // events keep being handled while the update thread is slow
+        int slot;
+        {
+            ScopedTimer timer(frameStats, "update wait");
+            slot = frameMailbox.acquire(0.1);
+        }
+        if (slot >= 0)
+        {
+            FramePacket& packet = framePackets[slot];
+            {
+                ScopedTimer timer(frameStats, "render");
+                display(window, packet);
+            }
+            glfwSwapBuffers(window);
+            framePacer.endFrame(frameStats);
+            endFrame(packet);
+            if (pendingRedraws > 0)
+            {
+                pendingRedraws--;
+            }
+        }
         glfwPollEvents();
     }
+    frameMailbox.close();
+    updateThread.join();
     glfwDestroyWindow(window);
     glfwTerminate();
     exit(EXIT_SUCCESS);
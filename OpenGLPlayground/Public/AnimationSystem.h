@@ -0,0 +1,103 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+#include "JobSystem.h"
+#include "TransformHierarchy.h"
+
+// drives the local transforms of hierarchy nodes from data instead of code
+// an animated node has at most one translation channel and one rotation channel, each either procedural
+// (an orbit, a spin) or a keyframed curve; channels of a kind are kept as separate arrays per field, so the
+// procedural ones are evaluated 4 at a time and every kind in parallel batches
+class AnimationSystem
+{
+public:
+	AnimationSystem();
+
+	// keys start at time 0 and are played in a loop of the last key's time, which must be greater than 0
+	int addTranslationCurve(const std::vector<float>& times, const std::vector<glm::vec3>& translations);
+	int addRotationCurve(const std::vector<float>& times, const std::vector<glm::quat>& rotations);
+
+	// the node keeps the parts of base that no channel drives, the scale always
+	int addNode(int node, const Transform& base = Transform());
+	void truncate(int numAnimated); // drops every animated node from numAnimated on, and their channels
+
+	// center + cosAxis * cos(angle) + sinAxis * sin(angle), with angle = speed * time + phase
+	void addOrbit(int animated, const glm::vec3& center, const glm::vec3& cosAxis, const glm::vec3& sinAxis, float speed, float phase = 0.0f);
+	// a rotation of speed * time + phase radians about axis
+	void addSpin(int animated, const glm::vec3& axis, float speed, float phase = 0.0f);
+	// the curve sampled at speed * time + offset
+	void addTranslationTrack(int animated, int curve, float speed = 1.0f, float offset = 0.0f);
+	void addRotationTrack(int animated, int curve, float speed = 1.0f, float offset = 0.0f);
+
+	// evaluates every channel at the given time and sets the local transforms of the animated nodes
+	void evaluate(double time, TransformHierarchy& transforms, JobSystem& jobs);
+
+	int getNumAnimated() const { return (int)nodes.size(); }
+
+private:
+	struct Curve
+	{
+		int firstKey;
+		int numKeys;
+		bool rotation; // slerped, otherwise the first three components are interpolated linearly
+	};
+
+	struct Orbit
+	{
+		int target; // animated node
+		glm::vec3 center;
+		glm::vec3 cosAxis;
+		glm::vec3 sinAxis;
+		float speed;
+		float phase;
+	};
+
+	struct Spin
+	{
+		int target;
+		glm::vec3 axis; // unit length
+		float speed;
+		float phase;
+	};
+
+	// a curve channel remembers the key it sampled last, so the next frame's search starts there
+	struct Track
+	{
+		int target;
+		int curve;
+		float speed;
+		float offset;
+		int cursor;
+	};
+
+	// keys of every curve, one after the other
+	std::vector<float> keyTimes;
+	std::vector<glm::vec4> keyValues;
+	std::vector<glm::vec2> keyArcs; // rotations: the angle to the next key and 1 / its sine, so a slerp takes two sines
+	std::vector<Curve> curves;
+
+	// per animated node, written by its channels
+	std::vector<int> nodes;
+	std::vector<float> scales;
+	std::vector<float> tx, ty, tz;
+	std::vector<float> qx, qy, qz, qw;
+
+	std::vector<Orbit> orbits;
+	std::vector<Spin> spins;
+	std::vector<Track> translationTracks;
+	std::vector<Track> rotationTracks;
+
+	// orbits and spins as one array per field, padded to a multiple of 4 with channels whose target is -1;
+	// rebuilt by evaluate() after channels were added or removed
+	std::vector<int> orbitTargets;
+	std::vector<float> orbitCx, orbitCy, orbitCz, orbitAx, orbitAy, orbitAz, orbitBx, orbitBy, orbitBz, orbitSpeeds, orbitPhases;
+	std::vector<int> spinTargets;
+	std::vector<float> spinX, spinY, spinZ, spinSpeeds, spinPhases;
+	bool packed;
+
+	int addCurve(const std::vector<float>& times, const std::vector<glm::vec4>& values, bool rotation);
+	void pack();
+	void evaluateOrbits(int begin, int end, float time); // ranges of packed channels, multiples of 4
+	void evaluateSpins(int begin, int end, float time);
+	void evaluateTracks(std::vector<Track>& tracks, int begin, int end, float time);
+};
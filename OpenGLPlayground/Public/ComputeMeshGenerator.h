@@ -0,0 +1,36 @@
+#pragma once
+#include <glad/glad.h>
+#include "GeometryCache.h"
+#include "ShaderProgram.h"
+
+// builds sphere and torus vertices and strip indices with compute shaders, straight into GPU buffers
+// the ranges use the same layout as GeometryCache, so they are bound and drawn the same way
+class ComputeMeshGenerator
+{
+public:
+	ComputeMeshGenerator();
+	void init(); // compiles the compute programs, needs a current GL context
+
+	GeometryRange createSphere(int numSlices, VertexFormat format);
+	GeometryRange createTorus(float innerRadius, float outerRadius, int numRings, VertexFormat format);
+	void destroy(GeometryRange& range);
+
+	// regenerate the vertices in place, cheap enough to run every frame for deforming parameters
+	void generateSphere(const GeometryRange& range, int numSlices);
+	void generateTorus(const GeometryRange& range, float innerRadius, float outerRadius, int numRings);
+
+	// compares the GPU output against uncached shapes from the CPU generators, returns true when they agree
+	bool validate();
+
+private:
+	ShaderProgram sphereProgram, torusProgram, stripProgram;
+
+	// uniform locations, looked up once in init()
+	GLint sphSlicesLoc, sphStrideLoc;
+	GLint torRingsLoc, torInnerLoc, torOuterLoc, torStrideLoc;
+	GLint stripColsLoc, stripRowsLoc, stripNextRowLoc, stripShortLoc, stripFirstWordLoc;
+
+	GeometryRange allocate(int gridSize, VertexFormat format);
+	void generateStrip(const GeometryRange& range, int gridSize, bool nextRowFirst);
+	bool compare(const char* name, const GeometryRange* expected, const GeometryRange& actual);
+};
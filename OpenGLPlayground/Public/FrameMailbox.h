@@ -0,0 +1,31 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+
+// hands whole frames from the update thread to the render thread through two slots:
+// while the render thread draws from one, the update thread fills the other, and a slot is never written
+// while it is read; the slots themselves are the caller's, the mailbox only decides who owns which
+class FrameMailbox
+{
+public:
+	static constexpr int NUM_SLOTS = 2;
+
+	FrameMailbox();
+
+	// update thread: the slot to fill next, once the previous frame has been taken; -1 after close()
+	int beginWrite();
+	void publish(int slot);
+
+	// render thread: the newest published slot, which it keeps until the next acquire() returns another;
+	// -1 when nothing arrived within the timeout, or after close()
+	int acquire(double timeoutSeconds);
+
+	void close(); // wakes both threads, every later call returns -1
+
+private:
+	std::mutex mutex;
+	std::condition_variable changed;
+	int ready;   // published and not taken yet, -1 for none
+	int reading; // held by the render thread, -1 before the first frame
+	bool closed;
+};
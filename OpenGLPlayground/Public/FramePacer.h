@@ -0,0 +1,38 @@
+#pragma once
+#include <chrono>
+#include "FrameStats.h"
+
+// paces the render loop after each swap: the swap interval, an optional frame rate limit,
+// and the measurements that tell the modes apart, the frame time jitter and the CPU time used
+class FramePacer
+{
+public:
+	FramePacer();
+
+	void setSwapInterval(int interval); // 0 swaps at once, 1 waits for the vertical blank; needs the context current
+	int getSwapInterval() const { return swapInterval; }
+
+	void setTargetFps(double fps); // 0 for no limit
+	double getTargetFps() const { return targetFps; }
+
+	// after the swap: waits for the frame's slot at the target rate, then adds the measurements to the stats;
+	// frames are timed from here to the next call, so a frame that is late does not make the next one early
+	void endFrame(FrameStats& stats);
+	double getFrameInterval() const { return frameInterval; } // seconds between the last two calls of endFrame()
+
+	static double getProcessCpuTime(); // seconds, of every thread of the process
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	Clock::time_point lastFrame;
+	Clock::time_point nextFrame;
+	Clock::duration sleepOvershoot; // the longest a short sleep took, the wait spins for the last this long
+	double frameInterval;
+	double lastCpuTime;
+	int swapInterval;
+	double targetFps;
+	bool started;
+
+	double wait(); // seconds waited
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include <chrono>
+#include <string>
+#include <vector>
+
+// collects named per-frame timings and counters, and prints their averages once per reporting interval
+class FrameStats
+{
+public:
+	FrameStats(double reportInterval = 1.0);
+
+	void addTime(const char* name, double milliseconds);
+	void addCount(const char* name, double value);
+	void endFrame(double currentTime); // prints and resets when the interval has elapsed, if enabled
+
+	// for stats recorded elsewhere, e.g. on another thread: adds the other's sums, and clears them for reuse
+	void merge(const FrameStats& other);
+	void clear();
+
+	void setEnabled(bool enable);
+	bool isEnabled() const { return enabled; }
+
+private:
+	struct Entry
+	{
+		std::string name;
+		double sum;
+		bool isTime;
+	};
+	std::vector<Entry> entries; // in the order they were first reported
+	double interval;
+	double lastReport;
+	int numFrames;
+	bool enabled;
+
+	Entry& find(const char* name, bool isTime);
+};
+
+// measures the CPU time of a scope and adds it to the stats when the scope ends
+class ScopedTimer
+{
+public:
+	ScopedTimer(FrameStats& stats, const char* name);
+	~ScopedTimer();
+
+private:
+	FrameStats& stats;
+	const char* name;
+	std::chrono::high_resolution_clock::time_point start;
+};
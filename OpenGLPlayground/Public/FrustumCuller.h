@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+// the six planes of a view-projection matrix, normals pointing inwards
+struct Frustum
+{
+	glm::vec4 planes[6]; // xyz normal, w distance
+
+	static Frustum fromMatrix(const glm::mat4& viewProjection);
+};
+
+// world-space bounding spheres kept as separate arrays of x, y, z and radius,
+// so that one frustum plane is tested against 4 spheres per SSE instruction
+class FrustumCuller
+{
+public:
+	FrustumCuller();
+	void clear();
+	void add(const glm::vec3& center, float radius); // sphere number i is the i-th one added
+
+	// appends the numbers of the spheres at least partly inside the frustum, in increasing order
+	void cull(const Frustum& frustum, std::vector<int>& visible) const;
+	int getCount() const { return count; }
+
+private:
+	// padded to a multiple of 4 with spheres that can never pass
+	std::vector<float> xs;
+	std::vector<float> ys;
+	std::vector<float> zs;
+	std::vector<float> radii;
+	int count;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <glad/glad.h>
+
+// a copy of the bindings and fixed-function state the application sets, so that calls which would set what is
+// already set never reach the driver; every bind of the application goes through here, and code that binds
+// behind its back (texture loading in SOIL) must be followed by invalidate()
+// issued and dropped calls are counted per category, on the GL thread only like the calls themselves
+class GLState
+{
+public:
+	enum Category { PROGRAM, BUFFER, TEXTURE, VERTEX_ARRAY, RASTER, DEPTH, NUM_CATEGORIES };
+
+	static void useProgram(GLuint program);
+	static void bindVertexArray(GLuint vertexArray);
+	static void bindBuffer(GLenum target, GLuint buffer); // element array binds are always issued, they belong to the vertex array
+	static void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+	static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	static void activeTexture(GLenum unit);
+	static void bindTexture(GLenum target, GLuint texture); // 2D textures are tracked per unit, other targets always issued
+
+	static void enable(GLenum capability);
+	static void disable(GLenum capability);
+	static void frontFace(GLenum mode);
+	static void cullFace(GLenum mode);
+	static void colorMask(GLboolean enable); // all four channels
+	static void depthFunc(GLenum func);
+	static void depthMask(GLboolean enable);
+
+	// GL unbinds what it deletes, and may hand the names out again
+	static void deleteBuffers(GLsizei count, const GLuint* buffers);
+	static void deleteTextures(GLsizei count, const GLuint* textures);
+	static void deleteVertexArrays(GLsizei count, const GLuint* vertexArrays);
+
+	static void invalidate(); // forgets everything, the next call of every kind is issued
+	static void setFiltering(bool enable); // off issues every call, to measure what filtering saves
+	static bool isFiltering();
+
+	// since the last resetCounters()
+	static int getNumIssued(Category category);
+	static int getNumFiltered(Category category);
+	static const char* getIssuedName(Category category); // stat names, e.g. "texture binds"
+	static const char* getFilteredName(Category category);
+	static void resetCounters();
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <glad/glad.h>
+#include <map>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MeshArena.h"
+
+enum class GeometryType { Sphere, Torus };
+
+// interleaved vertex layouts the cache can produce
+enum class VertexFormat
+{
+	PosTexNorm, // position (location 0), texture coords (location 1), normal (location 2)
+	Pos         // position only, for depth-only passes
+};
+
+struct GeometryKey
+{
+	GeometryType type;
+	VertexFormat format;
+	int precision;   // slices for spheres, rings for tori
+	float params[2]; // inner and outer radius for tori, unused for spheres
+
+	bool operator<(const GeometryKey& other) const;
+};
+
+// a range of GPU memory holding one generated shape, vertices first and indices after them
+struct GeometryRange
+{
+	GLuint buffer;
+	GLsizei vertexStride;
+	int numVertices;
+	GLintptr indexOffset;
+	GLenum mode;      // GL_TRIANGLES or GL_TRIANGLE_STRIP
+	GLenum indexType; // GL_UNSIGNED_SHORT whenever all vertices fit below the 16-bit restart index
+	GLsizei numIndices;
+	GLsizeiptr bytes;
+	VertexFormat format;
+};
+
+// one shape's sub-allocation in the arena, counted by the cache while anyone holds it
+struct ArenaShape
+{
+	Mesh mesh;
+	int refCount;
+	GLsizeiptr bytes; // its vertices and indices
+};
+
+// generates each unique procedural shape once and places it in a MeshArena, all of them in the same one
+class GeometryCache
+{
+public:
+	GeometryCache();
+
+	// views of shapes in the arena's layout, added to it on the first request; each request holds a reference
+	Mesh acquireSphere(MeshArena& arena, int numSlices);
+	Mesh acquireTorus(MeshArena& arena, float innerRadius, float outerRadius, int numRings);
+	// forgets the shape when the last user lets go; the arena cannot free, so its space stays until the arena goes
+	void release(const Mesh& mesh);
+
+	// an uncached copy of a shape, owned by the caller and left out of the statistics
+	static GeometryRange createSphere(int numSlices, VertexFormat format);
+	static GeometryRange createTorus(float innerRadius, float outerRadius, int numRings, VertexFormat format);
+
+	// statistics
+	float getHitRate() { return (hits + misses) > 0 ? (float)hits / (float)(hits + misses) : 0.0f; }
+	GLsizeiptr getResidentBytes() { return residentBytes; }
+	int getNumEntries() { return (int)arenaEntries.size(); }
+	void printStats();
+
+private:
+	std::map<GeometryKey, ArenaShape> arenaEntries;
+	int hits;
+	int misses;
+	GLsizeiptr residentBytes;
+
+	bool findInArena(const GeometryKey& key, Mesh& mesh);
+	Mesh insert(MeshArena& arena, const GeometryKey& key, const std::vector<glm::vec3>& vertices, const std::vector<glm::vec2>& texCoords,
+		const std::vector<glm::vec3>& normals, const std::vector<unsigned int>& stripIdxs, const std::vector<int>& listIdxs);
+	static GeometryRange upload(VertexFormat format, const std::vector<glm::vec3>& vertices, const std::vector<glm::vec2>& texCoords,
+		const std::vector<glm::vec3>& normals, const std::vector<unsigned int>& stripIdxs, const std::vector<int>& listIdxs);
+};
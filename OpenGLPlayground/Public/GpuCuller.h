@@ -0,0 +1,79 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "FrustumCuller.h"
+#include "HiZPyramid.h"
+#include "MeshArena.h"
+#include "ShaderProgram.h"
+
+// a static object drawn from the arena, one entry of the compute shader's input
+struct GpuObject
+{
+	glm::mat4 world;
+	glm::vec4 sphere; // world-space bounding sphere, filled in by setObjects()
+	GLuint mesh;      // index into the meshes given to setMeshes()
+	GLuint pad[3];
+};
+
+// culls static arena objects on the GPU: a compute shader tests every object's sphere against the frustum,
+// packs the survivors' object data and draw commands with an atomic counter, and a multi-draw draws them
+// the CPU work per pass is a dispatch and a draw, whatever the number of objects
+//
+// the camera pass can also cull by occlusion in two phases: cullEarly() keeps what last frame's depth pyramid
+// does not hide, and after those are drawn and the pyramid rebuilt, cullLate() gives the rejects a second chance
+class GpuCuller
+{
+public:
+	GpuCuller();
+	void init(MeshArena* meshArena, int numPasses); // needs a current GL context
+
+	void setMeshes(const std::vector<const Mesh*>& meshes); // arena meshes
+	void setObjects(std::vector<GpuObject>& objects); // computes the spheres and uploads, O(n) but only on change
+
+	// fills the pass's object storage and commands; shadowMatrix is multiplied into sh_mvp_matrix
+	void cull(int pass, const Frustum& frustum, const glm::mat4& shadowMatrix, bool litPass);
+	void cullEarly(int pass, const Frustum& frustum, const glm::mat4& viewProjection, const glm::mat4& shadowMatrix, const HiZPyramid& hiZ);
+	void cullLate(const glm::mat4& viewProjection, const glm::mat4& shadowMatrix, const HiZPyramid& hiZ);
+
+	// draws the survivors, with the program, material, texture and vertex array already set up
+	void draw(int pass, GLuint objectStorageBinding);
+	void drawLate(GLuint objectStorageBinding);
+
+	int getNumObjects() const { return numObjects; }
+	bool hasDrawCount() const { return multiDrawCount != nullptr; } // false when the draw count is not read on the GPU
+
+private:
+	typedef void (APIENTRYP MultiDrawElementsIndirectCountProc)(GLenum mode, GLenum type, const void* indirect,
+		GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+
+	enum Phase { FRUSTUM_ONLY, EARLY, LATE }; // same values as in the shader
+
+	// output buffers of one pass
+	struct PassBuffers
+	{
+		GLuint visible;  // ObjectData of the survivors
+		GLuint commands;
+		GLuint counter;
+	};
+
+	std::vector<PassBuffers> passes; // one per pass, then one for the late phase
+	std::vector<glm::vec4> meshBounds;
+	ShaderProgram program;
+	MeshArena* arena;
+	MultiDrawElementsIndirectCountProc multiDrawCount;
+	GLuint objectBuffer;
+	GLuint meshBuffer;
+	GLuint retestBuffer;
+	GLuint retestCounter;
+	int numObjects;
+
+	// uniform locations, looked up once in init()
+	GLint phaseLoc, numObjectsLoc, planesLoc, shadowMatrixLoc, litPassLoc;
+	GLint viewProjectionLoc, hiZValidLoc, hiZSizeLoc, hiZLevelsLoc;
+
+	void clear(GLuint buffer);
+	void dispatch(Phase phase, PassBuffers& buffers, const Frustum& frustum, const glm::mat4& shadowMatrix, bool litPass,
+		const glm::mat4& viewProjection, const HiZPyramid* hiZ);
+	void drawBuffers(PassBuffers& buffers, GLuint objectStorageBinding);
+};
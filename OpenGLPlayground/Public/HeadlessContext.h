@@ -0,0 +1,23 @@
+#pragma once
+
+// an OpenGL 4.3 core context without a window or display server, for headless runs on build servers:
+// EGL on a GPU device if there is one, otherwise on Mesa's surfaceless platform, which renders with llvmpipe
+// nothing is drawn to without a framebuffer object; only built where EGL is, create() fails elsewhere
+class HeadlessContext
+{
+public:
+	HeadlessContext();
+
+	bool create(); // makes the context current on the calling thread
+	void destroy();
+
+	const char* getPlatformName() const { return platformName; }
+	static void* getProcAddress(const char* name); // for gladLoadGLLoader()
+
+private:
+	void* display; // EGLDisplay
+	void* context; // EGLContext
+	const char* platformName;
+
+	bool createOn(void* candidate, const char* name);
+};
@@ -0,0 +1,34 @@
+#pragma once
+#include <glad/glad.h>
+#include "ShaderProgram.h"
+
+// a mip chain of the scene's depth where every texel holds the farthest depth of the pixels it covers,
+// so that a bounding rectangle can be tested for occlusion with a handful of fetches at a coarse level
+class HiZPyramid
+{
+public:
+	HiZPyramid();
+	void init(int width, int height); // needs a current GL context
+	void resize(int width, int height);
+
+	// copies the depth of the read framebuffer and reduces it level by level, with compute shaders
+	void build();
+
+	GLuint getTexture() const { return pyramid; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	int getNumLevels() const { return numLevels; }
+	bool isBuilt() const { return built; } // false until the first build() after a resize
+
+private:
+	ShaderProgram program;
+	GLuint depthCopy; // level 0 is read from here, depth textures cannot be bound as images
+	GLuint pyramid;   // GL_R32F, full resolution at level 0
+	int width;
+	int height;
+	int numLevels;
+	bool built;
+
+	// uniform locations, looked up once in init()
+	GLint srcLevelLoc, srcSizeLoc, dstSizeLoc;
+};
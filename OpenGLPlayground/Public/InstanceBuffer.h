@@ -0,0 +1,31 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+// attribute locations read by the instanced vertex shaders
+constexpr GLuint INSTANCE_MATRIX_LOCATION = 3; // a mat4 takes locations 3 to 6
+constexpr GLuint INSTANCE_COLOR_LOCATION = 7;
+
+struct InstanceData
+{
+	glm::mat4 transform; // relative to the draw's object transform
+	glm::vec4 color;     // multiplies the lit color
+};
+
+// per-instance data in one vertex buffer, fetched through attributes that advance once per instance
+class InstanceBuffer
+{
+public:
+	InstanceBuffer();
+	void upload(const std::vector<InstanceData>& instances); // the buffer keeps its name when it grows, attached meshes stay valid
+	void attach(Mesh& mesh, GLuint bindingIndex); // adds the instance attributes to the mesh's vertex array
+
+	int getCount() const { return count; }
+
+private:
+	GLuint buffer;
+	GLsizeiptr capacity;
+	int count;
+};
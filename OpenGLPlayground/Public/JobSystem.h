@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a pool of worker threads, each with its own queue of jobs
+// a thread takes the newest job of its own queue, and when that is empty steals the oldest job of another,
+// so a thread that runs out of work helps the others instead of waiting
+class JobSystem
+{
+public:
+	JobSystem();
+	~JobSystem();
+
+	void start(int numThreads); // counts the calling thread, 1 runs every job on the caller
+	void stop();
+
+	// calls body(begin, end) on consecutive ranges of at most batchSize indices, in parallel,
+	// and returns once all of [0, count) has been processed; the caller works too
+	void parallelFor(int count, int batchSize, const std::function<void(int, int)>& body);
+
+	int getNumThreads() const { return (int)queues.size(); }
+
+private:
+	struct Job
+	{
+		const std::function<void(int, int)>* body;
+		int begin;
+		int end;
+		std::atomic<int>* remaining; // jobs of the parallelFor() still to finish
+	};
+
+	// mutex-guarded, jobs are whole batches so the lock is taken rarely compared to the work done
+	struct WorkQueue
+	{
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkQueue>> queues; // queue 0 belongs to the caller of parallelFor()
+	std::vector<std::thread> workers;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<int> pending; // jobs queued and not yet taken
+	bool stopping;
+
+	bool runOne(int queue); // false when there was nothing to take or steal
+	void workerLoop(int queue);
+};
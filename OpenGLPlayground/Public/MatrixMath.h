@@ -0,0 +1,23 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// SSE kernels for the 4x4 matrices of the scene, with scalar fallbacks
+// results match glm to rounding: the same products are summed in a different order
+class MatrixMath
+{
+public:
+	static glm::mat4 multiply(const glm::mat4& a, const glm::mat4& b);
+	static void multiplyBatch(const glm::mat4& a, const glm::mat4* b, glm::mat4* out, int count); // out[i] = a * b[i]
+	static void multiplyBatch(const glm::mat4* a, const glm::mat4* b, glm::mat4* out, int count); // out[i] = a[i] * b[i]
+
+	// translate(translation) * rotate(angle, axis) * scale(scaling) written directly, without the two products
+	static glm::mat4 composeTRS(const glm::vec3& translation, float angle, const glm::vec3& axis, const glm::vec3& scaling);
+
+	static glm::mat4 affineInverse(const glm::mat4& m); // inverse of a matrix whose last row is 0, 0, 0, 1
+
+	// transpose(inverse(m)) of an affine matrix; a rotation with uniform scale s is its own inverse transpose
+	// up to 1 / s^2, which is taken instead of the cofactors whenever the columns are orthogonal and equally long
+	static glm::mat4 normalMatrix(const glm::mat4& m);
+	static void normalMatrixBatch(const glm::mat4* m, glm::mat4* out, int count); // 4 at a time, as separate arrays
+	static bool isUniformScaleRotation(const glm::mat4& m, float& squaredScale);
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+struct GeometryRange;
+
+// layout read by glMultiDrawElementsIndirect, one per draw
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// a drawable GPU resource: one vertex array object whose buffers and attribute formats are set up once,
+// so that drawing is a single bind followed by a single draw call
+// attributes are described with separate formats and buffer binding points (GL 4.3 vertex attrib binding)
+class Mesh
+{
+public:
+	Mesh();
+	void create(GLenum mode, GLsizei count); // count is vertices for array draws, indices once an index buffer is set
+	void createFromGeometry(const GeometryRange* range); // attributes follow the range's vertex format
+	// a range of indices and vertices inside a vertex array owned elsewhere, such as a MeshArena
+	void createView(GLuint sharedVao, GLenum mode, GLsizei count, GLenum indexType, GLintptr indexOffset, GLint baseVertex);
+	void destroy();
+
+	void setVertexBuffer(GLuint bindingIndex, GLuint buffer, GLintptr offset, GLsizei stride);
+	void setAttribute(GLuint location, GLint size, GLuint bindingIndex, GLuint relativeOffset);
+	void setIndexBuffer(GLuint buffer, GLenum type, GLintptr offset);
+	void setBindingDivisor(GLuint bindingIndex, GLuint divisor); // 1 advances the binding once per instance
+	void setBounds(const glm::vec3& center, float radius); // model-space bounding sphere, unbounded meshes are never culled
+
+	void bind() const;
+	void draw() const; // expects the mesh to be bound
+	void drawInstanced(GLsizei instanceCount) const;
+	GLuint getVao() const { return vao; }
+	GLenum getMode() const { return mode; }
+	GLenum getIndexType() const { return indexType; }
+	DrawElementsIndirectCommand getIndirectCommand(GLuint instanceCount, GLuint baseInstance) const; // indexed meshes only
+	const glm::vec4& getBounds() const { return bounds; } // center in xyz, radius in w
+
+private:
+	GLuint vao;
+	GLenum mode;
+	GLsizei count;
+	GLenum indexType; // GL_NONE for non-indexed meshes
+	GLintptr indexOffset;
+	GLint baseVertex;
+	bool ownsVao;
+	glm::vec4 bounds;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Mesh.h"
+
+// the single vertex layout of the arena: position (location 0), texture coords (location 1), normal (location 2)
+struct ArenaVertex
+{
+	glm::vec3 position;
+	glm::vec2 texCoord;
+	glm::vec3 normal;
+};
+
+// per-draw object index, advanced once per instance so that it reads the draw's base instance
+constexpr GLuint DRAW_ID_LOCATION = 8;
+
+// suballocates every static mesh from one vertex buffer and one 32-bit index buffer behind one vertex array,
+// so that any number of them can be drawn with a single glMultiDrawElementsIndirect
+class MeshArena
+{
+public:
+	MeshArena();
+	void init(); // creates the buffers and the vertex array, needs a current GL context
+
+	// triangle lists, or strips split by the 32-bit fixed restart index, which is compared before the base vertex is added
+	Mesh add(const std::vector<ArenaVertex>& vertices, const std::vector<GLuint>& indices, GLenum mode = GL_TRIANGLES);
+	Mesh add(const std::vector<ArenaVertex>& vertices); // unindexed triangle lists get sequential indices
+	void upload(); // sends everything added so far, call again after adding more meshes
+
+	void reserveDraws(int numDraws); // grows the draw id buffer to cover base instances up to numDraws
+
+	GLuint getVao() const { return vao; }
+	GLsizeiptr getResidentBytes() const { return vertices.size() * sizeof(ArenaVertex) + indices.size() * sizeof(GLuint); }
+
+private:
+	std::vector<ArenaVertex> vertices;
+	std::vector<GLuint> indices;
+	GLuint vao;
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	GLuint drawIdBuffer;
+	int drawIdCapacity;
+};
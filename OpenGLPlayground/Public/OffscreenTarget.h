@@ -0,0 +1,28 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+
+// a color and depth framebuffer that stands in for the window's in headless runs
+class OffscreenTarget
+{
+public:
+	OffscreenTarget();
+	bool init(int width, int height); // needs a current GL context, false if the framebuffer is incomplete
+
+	GLuint getFramebuffer() const { return framebuffer; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	// reads the color buffer back and writes it top row first, as images are stored; waits for the GPU
+	bool savePng(const std::string& path);
+
+private:
+	GLuint framebuffer;
+	GLuint colorBuffer;
+	GLuint depthBuffer;
+	int width;
+	int height;
+	std::vector<unsigned char> pixels; // kept for the next save
+	std::vector<unsigned char> flipped;
+};
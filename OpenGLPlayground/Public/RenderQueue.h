@@ -0,0 +1,122 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+#include "FrustumCuller.h"
+#include "JobSystem.h"
+#include "Mesh.h"
+#include "MeshArena.h"
+#include "TransformHierarchy.h"
+#include "UniformBlocks.h"
+
+enum RenderPass { SHADOW_PASS, LIT_PASS, NUM_RENDER_PASSES };
+constexpr unsigned int SHADOW_PASS_BIT = 1 << SHADOW_PASS;
+constexpr unsigned int LIT_PASS_BIT = 1 << LIT_PASS;
+constexpr unsigned int ALL_PASSES = SHADOW_PASS_BIT | LIT_PASS_BIT;
+
+// everything needed to draw one object, in every pass it takes part in
+struct DrawItem
+{
+	unsigned int passMask;
+	const Mesh* meshes[NUM_RENDER_PASSES]; // the shadow pass may use position-only meshes
+	GLuint texture; // bound to texture unit 0, 0 for untextured
+	int material;   // entry in the material uniform buffer
+	GLenum frontFace;
+	int transform;  // node in the scene's TransformHierarchy
+	int instanceCount; // 0 for a single object, otherwise an instanced draw of meshes with instance attributes attached
+};
+
+// the programs of one pass, for each way the queue can draw an item
+struct PassPrograms
+{
+	GLuint single;    // object data in the ObjectBlock uniform block
+	GLuint instanced; // ObjectBlock plus per-instance attributes
+	GLuint multiDraw; // object data in ObjectStorage, indexed by the draw id of the arena
+};
+
+typedef void (*MaterialBinder)(int material);
+
+// collects the frame's draw items, orders them by 64-bit sort keys and submits them
+// while skipping binds that would not change anything
+// consecutive arena meshes sharing the same state are merged into one glMultiDrawElementsIndirect
+//
+// submitting is split in two: record() turns the sorted keys into lists of small commands, a list per range of keys
+// and in parallel, and execute() replays the lists in order on the GL thread
+class RenderQueue
+{
+public:
+	RenderQueue();
+
+	// multi-draw commands and object storage are streamed through the same buffer as the object ring
+	void init(MeshArena* meshArena, UniformRing* objectRing, StreamBuffer* streamBuffer); // needs a current GL context
+	void setPrograms(int pass, const PassPrograms& passPrograms);
+	// position-only programs for a camera depth prepass, writing the depth the lit programs compute
+	void setDepthPrograms(const PassPrograms& passPrograms);
+	void clear();
+	bool add(const DrawItem& item); // up to 2^20 items per frame, the item index has no more bits in the sort key; false past them
+
+	void computeBounds(const TransformHierarchy& transforms); // world-space bounding spheres of all items, once per frame
+	// the object data of every item in every pass, once per frame and in parallel, so that drawing only copies it
+	// shadowMatrices are multiplied into sh_mvp_matrix, the lit pass's one includes the shadow map's texture bias
+	void computeObjects(const TransformHierarchy& transforms, const glm::mat4 shadowMatrices[NUM_RENDER_PASSES], JobSystem& jobs);
+	void cull(int pass, const Frustum& frustum); // keeps the pass's items that intersect the frustum
+	// builds and radix-sorts the keys of the items kept by cull(): program, texture, material, mesh, then front-to-back depth
+	// every pass keeps its own keys and commands, so all of them can be prepared before any is executed, on another thread
+	void sort(int pass, const glm::mat4& viewMatrix, const TransformHierarchy& transforms);
+	void record(int pass, JobSystem& jobs); // the commands of the keys sorted by sort(), and the pass's multi-draw data
+	void execute(int pass, MaterialBinder bindMaterial); // the only calls that need the GL context
+	void executeDepth(int pass); // the pass with the depth programs and without textures or materials
+
+	// statistics of the last execute()
+	int getNumDraws() const { return numDraws; } // draw calls, a multi-draw counts once
+	int getNumInstances() const { return numInstances; } // objects drawn, counting every instance
+	int getNumStateChanges() const { return numStateChanges; }
+	int getNumCulled(int pass) const { return numCulled[pass]; } // items of the pass rejected by cull()
+
+private:
+	enum CommandType : GLuint { BIND_PROGRAM, BIND_MESH, BIND_TEXTURE, BIND_MATERIAL, SET_FRONT_FACE, DRAW, MULTI_DRAW };
+
+	// one step of a recorded pass, 16 bytes
+	struct Command
+	{
+		CommandType type;
+		GLuint value;        // the program, texture, material or front face; the item for meshes and draws
+		GLuint firstCommand; // multi-draws only, a run of the pass's indirect commands
+		GLuint numCommands;
+	};
+
+	std::vector<DrawItem> items;
+	FrustumCuller culler; // one sphere per item
+	std::vector<int> visible;
+	bool allInAllPasses; // lets cull() skip filtering by pass
+	bool full; // items were rejected since clear(), reported once
+	std::vector<uint64_t> keys[NUM_RENDER_PASSES]; // sorted by sort()
+	std::vector<uint64_t> scratch;
+	std::vector<std::vector<Command>> commandLists[NUM_RENDER_PASSES]; // one per RECORD_BATCH_SIZE keys, in key order
+	std::vector<int> listSlots; // the first object storage slot of each list
+	std::vector<DrawElementsIndirectCommand> commands[NUM_RENDER_PASSES]; // of the multi-draws, in key order
+	std::vector<ObjectData> objects[NUM_RENDER_PASSES]; // their object storage, indexed by the base instance
+	std::vector<ObjectData> itemObjects[NUM_RENDER_PASSES]; // filled by computeObjects(), indexed like items
+	PassPrograms programs[NUM_RENDER_PASSES];
+	PassPrograms depthPrograms;
+	MeshArena* arena;
+	UniformRing* ring;
+	StreamBuffer* stream;
+	GLsizeiptr storageAlignment;
+	int numDraws;
+	int numInstances;
+	int numStateChanges;
+	int numCulled[NUM_RENDER_PASSES];
+	bool streamed[NUM_RENDER_PASSES]; // the pass's multi-draw data was streamed since record(), to this buffer and offset
+	GLuint streamedBuffers[NUM_RENDER_PASSES];
+	GLintptr streamedOffsets[NUM_RENDER_PASSES];
+
+	GLuint programFor(const DrawItem& item, int pass) const;
+	GLuint depthProgramFor(GLuint program, int pass) const;
+	bool isMultiDrawable(const DrawItem& item, int pass) const;
+	bool sameState(const DrawItem& a, const DrawItem& b, int pass) const;
+	void replay(int pass, MaterialBinder bindMaterial);
+	void recordRange(int pass, int begin, int end, int firstSlot, std::vector<Command>& list);
+	void radixSort(std::vector<uint64_t>& keys);
+};
@@ -0,0 +1,33 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <unordered_map>
+
+// a linked program plus the table of its active uniforms, attributes and blocks, read once after linking
+// look handles up at init time and keep them, so no string lookups reach the driver while rendering
+class ShaderProgram
+{
+public:
+	ShaderProgram();
+	void create(const char* vp, const char* fp);
+	void createCompute(const char* cp);
+
+	GLuint getId() { return id; }
+
+	// reflected handles, -1 when the program has no such active resource (flagged in debug builds)
+	GLint uniform(const std::string& name);
+	GLint attribute(const std::string& name);
+	GLint uniformBlock(const std::string& name);
+	GLint storageBlock(const std::string& name);
+
+private:
+	GLuint id;
+	std::unordered_map<std::string, GLint> uniforms;   // name -> location, default block only
+	std::unordered_map<std::string, GLint> attributes; // name -> location
+	std::unordered_map<std::string, GLint> uniformBlocks; // name -> block index
+	std::unordered_map<std::string, GLint> storageBlocks; // name -> block index
+
+	void reflect();
+	void reflectInterface(GLenum programInterface, std::unordered_map<std::string, GLint>& table);
+	GLint lookup(const std::unordered_map<std::string, GLint>& table, const std::string& name, const char* kind);
+};
@@ -13,6 +13,8 @@ public:
 	int getNumVertices() { return numVertices; }
 	int getNumIndices() { return numIndices; }
 	std::vector<int> getIndices() { return indices; }
+	int getNumStripIndices() { return (int)stripIndices.size(); }
+	std::vector<unsigned int> getStripIndices() { return stripIndices; }
 	std::vector<glm::vec3> getVertices() { return vertices; }
 	std::vector<glm::vec2> getTexCoords() { return texCoords; }
 	std::vector<glm::vec3> getNormals() { return normals; }
@@ -21,6 +23,7 @@ private:
 	int numVertices;
 	int numIndices;
 	std::vector<int> indices;
+	std::vector<unsigned int> stripIndices; // triangle strip rows separated by Utils::restartIndex
 	std::vector<glm::vec3> vertices;
 	std::vector<glm::vec2> texCoords;
 	std::vector<glm::vec3> normals;
@@ -0,0 +1,50 @@
+#pragma once
+#include <glad/glad.h>
+#include <vector>
+
+// where an allocation landed: write through data, then bind buffer at offset
+struct StreamAllocation
+{
+	void* data;
+	GLuint buffer; // changes when the buffer has to grow, so bind the one the allocation returns
+	GLintptr offset;
+};
+
+// one buffer split into a region per frame in flight, for data that is written once per frame and read by the GPU
+// the buffer stays persistently mapped when glBufferStorage is available (GL 4.4 or ARB_buffer_storage),
+// otherwise writes go to a CPU copy and are sent with unsynchronized maps in flush()
+// each region is fenced at the end of its frame, and waited on before it is written again
+class StreamBuffer
+{
+public:
+	StreamBuffer();
+	void init(GLsizeiptr frameSize, int numFrames); // needs a current GL context
+
+	void beginFrame(); // moves to the next region, waiting for the GPU if it is still reading it
+	StreamAllocation allocate(GLsizeiptr size, GLsizeiptr alignment); // grows the buffer rather than failing
+	void flush(); // makes everything allocated so far visible to the following draws
+	void endFrame(); // fences the region, buffers replaced by growing are deleted here
+
+	bool isPersistent() const { return persistent; }
+	// statistics of the last frame
+	GLsizeiptr getBytesStreamed() const { return bytesStreamed; }
+	double getFenceWaitTime() const { return fenceWaitTime; } // milliseconds
+
+private:
+	std::vector<char> shadow; // CPU copy of the current region when not persistently mapped
+	std::vector<GLsync> fences; // one per region, 0 when the region is free
+	std::vector<GLuint> retired; // outgrown this frame, still bound by earlier allocations
+	char* mapped;
+	GLuint buffer;
+	GLsizeiptr regionSize;
+	int numRegions;
+	int region;
+	GLintptr head;    // relative to the start of the region
+	GLintptr flushed; // up to where the CPU copy has been sent
+	bool persistent;
+	GLsizeiptr bytesStreamed;
+	double fenceWaitTime;
+
+	void create(GLsizeiptr frameSize);
+	void retire();
+};
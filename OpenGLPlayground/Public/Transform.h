@@ -0,0 +1,24 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// a rotation, a uniform scale and a translation in 32 bytes, half of a mat4
+// products and inverses of such transforms are again such transforms, so a scene graph never needs a matrix;
+// matrices are only built when a transform is uploaded
+struct Transform
+{
+	glm::vec3 translation;
+	float scale;
+	glm::quat rotation;
+
+	Transform(); // identity
+	Transform(const glm::vec3& translation, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), float scale = 1.0f);
+	static Transform fromAxisAngle(const glm::vec3& translation, float angle, const glm::vec3& axis, float scale = 1.0f);
+
+	Transform operator*(const Transform& child) const; // applies child first, like the matrix product
+	Transform inverse() const;
+	glm::vec3 transformPoint(const glm::vec3& point) const;
+
+	glm::mat4 toMatrix() const;
+	void toAffineRows(glm::vec4 rows[3]) const; // the top three rows of toMatrix(), the last one is always (0, 0, 0, 1)
+};
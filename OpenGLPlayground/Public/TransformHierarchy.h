@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include "JobSystem.h"
+#include "Transform.h"
+
+// a flat scene graph: nodes live in arrays in parent-before-child order, so one forward sweep
+// turns local transforms into world transforms without recursion or a matrix stack
+// only nodes whose local transform changed, or whose parent moved, are recomputed
+//
+// a fixed-step simulation draws between its last two steps: storePrevious() before a step's update() keeps the
+// world transforms of the step before, and interpolate() blends the two into what getWorld() returns
+class TransformHierarchy
+{
+public:
+	TransformHierarchy();
+
+	int addNode(int parent, const Transform& local = Transform()); // parent must already exist, -1 for a root
+	void truncate(int numNodes); // drops every node from numNodes on
+	void setLocal(int node, const Transform& local); // marks the node dirty
+
+	void update(); // recomputes the world transforms of dirty nodes and their descendants
+	const Transform& getWorld(int node) const { return drawn[node]; } // blended if interpolate() was called since update()
+
+	void storePrevious();
+	// alpha 0 is the previous step, 1 the last; until storePrevious() follows a change of nodes, the last step is drawn
+	void interpolate(float alpha, JobSystem& jobs);
+
+	int getNumNodes() const { return (int)parents.size(); }
+	int getNumUpdated() const { return numUpdated; } // world transforms recomputed by the last update()
+
+private:
+	std::vector<int> parents;
+	std::vector<Transform> locals;
+	std::vector<Transform> worlds;
+	std::vector<unsigned char> dirty;
+	std::vector<Transform> previous; // of the step before, empty when the nodes changed since
+	std::vector<Transform> blended;
+	const Transform* drawn; // worlds, previous or blended
+	int numUpdated;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "StreamBuffer.h"
+
+// binding points of the std140 blocks declared in the shaders
+constexpr GLuint FRAME_BLOCK_BINDING = 0;
+constexpr GLuint MATERIAL_BLOCK_BINDING = 1;
+constexpr GLuint OBJECT_BLOCK_BINDING = 2;
+constexpr GLuint OBJECT_STORAGE_BINDING = 3; // shader storage, ObjectData per draw of a multi-draw call
+
+// CPU mirrors of the shader blocks, member order and padding follow std140
+
+struct FrameData // FrameBlock: camera, light and window, written once per frame when it changes
+{
+	glm::mat4 vMatrix;
+	glm::mat4 pMatrix;
+	glm::vec4 lightAmbient;  // PositionalLight light
+	glm::vec4 lightDiffuse;
+	glm::vec4 lightSpecular;
+	glm::vec4 lightPosition; // xyz used, w pads the struct to 64 bytes
+	glm::vec4 globalAmbient;
+	glm::vec2 windowSize;
+	glm::vec2 pad;
+};
+
+struct MaterialData // MaterialBlock
+{
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+	float shininess;
+	float pad[3];
+};
+
+struct ObjectData // ObjectBlock: per draw
+{
+	glm::vec4 mMatrix[3]; // rows of the affine model matrix, the columns of a mat3x4 in the shaders
+	glm::vec4 nMatrix[3]; // rows of the normal matrix, stored the same way
+	glm::mat4 shMvpMatrix;
+};
+
+// one uniform block per draw, each written to a fresh aligned range of the frame's stream buffer
+class UniformRing
+{
+public:
+	UniformRing();
+	void init(StreamBuffer* streamBuffer, GLuint bindingIndex, GLsizeiptr dataSize);
+	void push(const void* data); // copies the block into the stream and binds it for the following draw
+
+private:
+	StreamBuffer* stream;
+	GLuint binding;
+	GLsizeiptr size;
+	GLsizeiptr alignment;
+};
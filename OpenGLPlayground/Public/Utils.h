@@ -4,6 +4,7 @@
 #include <string>
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 class Utils
 {
@@ -12,9 +13,19 @@ public:
     static std::string getResourcePath();
     static std::string readShaderSource(const char* filePath);
     static GLuint createShaderProgram(const char* vp, const char* fp);
+    static GLuint createComputeProgram(const char* cp);
     static GLuint loadTexture(const std::string& directoryPath, const std::string& texImageName);
+    static void setMaxAnisotropy(float anisotropy); // for textures loaded after it, never above the driver's maximum
     static float toRadians(float degrees);
     static void calculateNormal(const float* verts, float* outNormal);
+    static std::vector<GLuint> buildGridStrip(int numCols, int numRows, bool nextRowFirst);
+    // features newer than the GL 4.3 loader, present when the context is at least major.minor or has the extension
+    static bool hasGLSupport(int major, int minor, const char* extension);
+    static void* loadGLFunction(const char* name, int major, int minor, const char* extension); // null when not supported
+    static void setGLLoader(GLADloadproc loader); // where loadGLFunction() looks, glfwGetProcAddress unless a context was made without GLFW
+
+    // restart marker written by buildGridStrip, matches GL_PRIMITIVE_RESTART_FIXED_INDEX for 32-bit indices
+    static constexpr GLuint restartIndex = 0xFFFFFFFF;
 
     // GOLD material - ambient, diffuse, specular, and shininess
     static float* goldAmbient() { static float a[4] = { 0.2473f, 0.1995f, 0.0745f, 1 }; return (float*)a; }
@@ -33,5 +44,7 @@ public:
     static float bronzeShininess() { return 25.6f; }
 
 private:
+    static GLADloadproc glLoader;
+    static float maxAnisotropy;
     static void checkCompileErrors(GLuint shader, const std::string& type);
 };
@@ -6,6 +6,7 @@ in vec3 varyingLightDir;   // vector pointing to the light
 in vec3 varyingVertPos;    // vertex position in world space
 in vec3 varyingHalfVec;    // vector between L and V
 in vec4 shadow_coord;      // coordinates in the shadow map corresponding to the current pixel being rendered
+in vec4 varyingTint;       // per-instance color
 
 layout (binding=0) uniform sampler2D texSamp; // (binding=0) means texture unit 0
 layout (binding=1) uniform sampler2DShadow shadowSamp;
@@ -26,15 +27,27 @@ struct Material
     float shininess;
 };
 
-uniform mat4 m_matrix;
-uniform mat4 v_matrix;
-uniform mat4 p_matrix;
-uniform mat4 n_matrix;
-uniform vec4 globalAmb;
-uniform PositionalLight light;
-uniform Material material;
-uniform mat4 shadowMVP;
-uniform vec2 windowSize;
+// bindings match UniformBlocks.h
+layout (std140, binding = 0) uniform FrameBlock
+{
+    mat4 v_matrix;
+    mat4 p_matrix;
+    PositionalLight light;
+    vec4 globalAmb;
+    vec2 windowSize;
+};
+
+layout (std140, binding = 1) uniform MaterialBlock
+{
+    Material material;
+};
+
+layout (std140, binding = 2) uniform ObjectBlock
+{
+    mat3x4 m_matrix; // the transposed affine matrix, its columns are the rows that are not (0, 0, 0, 1)
+    mat3x4 n_matrix; // the same, both multiply a vector from the left
+    mat4 sh_mvp_matrix;
+};
 
 out vec4 color;
 
@@ -96,4 +109,5 @@ void main()
     {
         color = texColor * color;
     }
+    color *= varyingTint;
 }
\ No newline at end of file
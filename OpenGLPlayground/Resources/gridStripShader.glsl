@@ -0,0 +1,55 @@
+#version 430
+
+layout (local_size_x = 64) in;
+
+// index words, each holding one 32-bit index or two packed 16-bit indices
+layout (std430, binding = 0) writeonly buffer IndexData
+{
+    uint indexWords[];
+};
+
+uniform int numCols;
+uniform int numRows;
+uniform bool nextRowFirst; // which row leads each pair, decides the winding
+uniform bool shortIndices;
+uniform int firstWord;     // where the indices start in the buffer
+
+// the i-th index of the strip built by Utils::buildGridStrip: one strip per row, rows joined by the restart index
+uint stripIndex(int i)
+{
+    int rowLength = 2 * (numCols + 1) + 1; // a pair for every column, then the restart index
+    int row = i / rowLength;
+    int r = i % rowLength;
+    if (r == rowLength - 1)
+    {
+        return 0xFFFFFFFFu;
+    }
+    uint lower = uint(row * (numCols + 1) + r / 2);
+    uint upper = lower + uint(numCols + 1);
+    return ((r % 2 == 0) == nextRowFirst) ? upper : lower;
+}
+
+void main()
+{
+    int id = int(gl_GlobalInvocationID.x);
+    int numIndices = numRows * (2 * (numCols + 1) + 1) - 1;
+    if (shortIndices)
+    {
+        // truncating keeps the fixed restart index valid, 0xFFFFFFFF becomes 0xFFFF
+        if (2 * id >= numIndices)
+        {
+            return;
+        }
+        uint lo = stripIndex(2 * id) & 0xFFFFu;
+        uint hi = (2 * id + 1 < numIndices) ? (stripIndex(2 * id + 1) & 0xFFFFu) : 0u;
+        indexWords[firstWord + id] = lo | (hi << 16);
+    }
+    else
+    {
+        if (id >= numIndices)
+        {
+            return;
+        }
+        indexWords[firstWord + id] = stripIndex(id);
+    }
+}
@@ -0,0 +1,46 @@
+#version 430
+
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// the previous level of the pyramid, or the depth copy when writing level 0
+layout (binding = 0) uniform sampler2D srcDepth;
+layout (binding = 0, r32f) writeonly uniform image2D dstLevel;
+
+uniform int srcLevel;
+uniform ivec2 srcSize;
+uniform ivec2 dstSize;
+
+void main()
+{
+    ivec2 dst = ivec2(gl_GlobalInvocationID.xy);
+    if (dst.x >= dstSize.x || dst.y >= dstSize.y)
+    {
+        return;
+    }
+
+    // a 2x2 footprint, widened to 3 texels where an odd source row or column would otherwise be left out
+    ivec2 first = dst * 2;
+    ivec2 last = min(first + 1, srcSize - 1);
+    if (dst.x == dstSize.x - 1 && (srcSize.x & 1) == 1)
+    {
+        last.x = srcSize.x - 1;
+    }
+    if (dst.y == dstSize.y - 1 && (srcSize.y & 1) == 1)
+    {
+        last.y = srcSize.y - 1;
+    }
+    if (srcSize == dstSize)
+    {
+        last = first = dst; // level 0 is a straight copy
+    }
+
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+    {
+        for (int x = first.x; x <= last.x; x++)
+        {
+            farthest = max(farthest, texelFetch(srcDepth, ivec2(x, y), srcLevel).r);
+        }
+    }
+    imageStore(dstLevel, dst, vec4(farthest));
+}
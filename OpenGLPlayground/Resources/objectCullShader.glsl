@@ -0,0 +1,179 @@
+#version 430
+
+layout (local_size_x = 64) in;
+
+struct CullObject
+{
+    mat4 world;
+    vec4 sphere; // world-space center and radius
+    uint mesh;   // entry in the mesh table
+};
+
+struct CullMesh
+{
+    uint count;
+    uint firstIndex;
+    int baseVertex;
+};
+
+struct ObjectData
+{
+    mat3x4 m_matrix; // the transposed affine matrix, its columns are the rows that are not (0, 0, 0, 1)
+    mat3x4 n_matrix; // the same, both multiply a vector from the left
+    mat4 sh_mvp_matrix;
+};
+
+// layout of DrawElementsIndirectCommand
+struct DrawCommand
+{
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+// bindings match GpuCuller.cpp
+layout (std430, binding = 0) readonly buffer Objects
+{
+    CullObject objects[];
+};
+
+layout (std430, binding = 1) readonly buffer Meshes
+{
+    CullMesh meshes[];
+};
+
+layout (std430, binding = 2) writeonly buffer VisibleObjects
+{
+    ObjectData visible[];
+};
+
+layout (std430, binding = 3) writeonly buffer Commands
+{
+    DrawCommand commands[];
+};
+
+// the number of survivors, also the draw count read by the multi-draw
+layout (std430, binding = 4) buffer Counter
+{
+    uint drawCount;
+};
+
+// objects in the frustum but behind last frame's depth, tested again once this frame's depth is known
+layout (std430, binding = 5) buffer Retest
+{
+    uint retestIndices[];
+};
+
+layout (std430, binding = 6) buffer RetestCounter
+{
+    uint retestCount;
+};
+
+// texture unit 2, units 0 and 1 hold the lit pass's texture and shadow map
+layout (binding = 2) uniform sampler2D hiZ;
+
+const int FRUSTUM_ONLY = 0;
+const int EARLY = 1; // frustum, then occlusion against last frame's pyramid
+const int LATE = 2;  // occlusion of the early rejects against this frame's pyramid
+
+uniform int phase;
+uniform uint numObjects;
+uniform vec4 frustumPlanes[6];
+uniform mat4 shadowMatrix;   // light projection and view, with the texture bias in the lit pass
+uniform bool litPass;        // the shadow pass only needs sh_mvp_matrix
+uniform mat4 viewProjection; // of the camera, for the occlusion test
+uniform bool hiZValid;       // false until a pyramid has been built
+uniform ivec2 hiZSize;
+uniform int hiZLevels;
+
+// true when the sphere's screen rectangle lies entirely behind the farthest depth stored over it
+bool isOccluded(vec4 sphere)
+{
+    vec3 low = vec3(1e30);
+    vec3 high = vec3(-1e30);
+    for (int corner = 0; corner < 8; corner++)
+    {
+        vec3 offset = vec3((corner & 1) != 0 ? 1.0 : -1.0, (corner & 2) != 0 ? 1.0 : -1.0, (corner & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = viewProjection * vec4(sphere.xyz + offset * sphere.w, 1.0);
+        if (clip.w <= 0.0)
+        {
+            return false; // reaches behind the camera, the rectangle would be meaningless
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        low = min(low, ndc);
+        high = max(high, ndc);
+    }
+
+    vec2 uvLow = clamp(low.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvHigh = clamp(high.xy * 0.5 + 0.5, 0.0, 1.0);
+    float nearestDepth = low.z * 0.5 + 0.5;
+
+    // the coarsest level at which the rectangle is at most a texel wide, so it touches at most 2x2 texels
+    vec2 pixels = (uvHigh - uvLow) * vec2(hiZSize);
+    int level = clamp(int(ceil(log2(max(max(pixels.x, pixels.y), 1.0)))), 0, hiZLevels - 1);
+    ivec2 levelSize = max(hiZSize >> level, ivec2(1));
+
+    // one texel further on each side, edge texels of odd-sized levels cover a little more than their share
+    ivec2 first = clamp(ivec2(uvLow * vec2(levelSize)), ivec2(0), levelSize - 1);
+    ivec2 last = clamp(ivec2(uvHigh * vec2(levelSize)) + 1, ivec2(0), levelSize - 1);
+    float farthest = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+    {
+        for (int x = first.x; x <= last.x; x++)
+        {
+            farthest = max(farthest, texelFetch(hiZ, ivec2(x, y), level).r);
+        }
+    }
+    return nearestDepth > farthest;
+}
+
+void main()
+{
+    uint id = gl_GlobalInvocationID.x;
+    if (phase == LATE)
+    {
+        if (id >= retestCount)
+        {
+            return;
+        }
+        id = retestIndices[id];
+    }
+    else if (id >= numObjects)
+    {
+        return;
+    }
+
+    CullObject object = objects[id];
+    if (phase != LATE)
+    {
+        for (int i = 0; i < 6; i++)
+        {
+            if (dot(frustumPlanes[i].xyz, object.sphere.xyz) + frustumPlanes[i].w < -object.sphere.w)
+            {
+                return;
+            }
+        }
+    }
+    if (phase != FRUSTUM_ONLY && hiZValid && isOccluded(object.sphere))
+    {
+        if (phase == EARLY)
+        {
+            retestIndices[atomicAdd(retestCount, 1)] = id;
+        }
+        return;
+    }
+
+    // survivors are packed in whatever order they arrive, the base instance ties each draw to its object data
+    uint slot = atomicAdd(drawCount, 1);
+    if (litPass)
+    {
+        visible[slot].m_matrix = transpose(mat4x3(object.world));
+        visible[slot].n_matrix = mat3x4(inverse(object.world));
+    }
+    visible[slot].sh_mvp_matrix = shadowMatrix * object.world;
+
+    CullMesh mesh = meshes[object.mesh];
+    commands[slot] = DrawCommand(mesh.count, 1, mesh.firstIndex, mesh.baseVertex, slot);
+}
@@ -0,0 +1,48 @@
+#version 430
+
+layout (local_size_x = 64) in;
+
+// interleaved vertices, 8 floats (position, tex coords, normal) or 3 floats (position only) each
+layout (std430, binding = 0) writeonly buffer VertexData
+{
+    float vertexVals[];
+};
+
+uniform int numSlices;
+uniform int vertexStride; // in floats
+
+// converts degrees the same way as Utils::toRadians, so the output matches the CPU generator
+float toRadians(float degrees)
+{
+    return (degrees * 2.0 * 3.14159) / 360.0;
+}
+
+void main()
+{
+    int id = int(gl_GlobalInvocationID.x);
+    if (id >= (numSlices + 1) * (numSlices + 1))
+    {
+        return;
+    }
+    int i = id / (numSlices + 1); // horizontal slice
+    int j = id % (numSlices + 1); // vertical slice
+
+    // cos(asin(y)) written as sqrt(1 - y^2), asin loses precision near the poles on some GPUs
+    float y = cos(toRadians(180.0 - float(i) * 180.0 / float(numSlices)));
+    float ringRadius = sqrt(max(1.0 - y * y, 0.0));
+    float x = -cos(toRadians(float(j) * 360.0 / float(numSlices))) * ringRadius;
+    float z = sin(toRadians(float(j) * 360.0 / float(numSlices))) * ringRadius;
+
+    int base = id * vertexStride;
+    vertexVals[base + 0] = x;
+    vertexVals[base + 1] = y;
+    vertexVals[base + 2] = z;
+    if (vertexStride == 8)
+    {
+        vertexVals[base + 3] = float(j) / float(numSlices);
+        vertexVals[base + 4] = float(i) / float(numSlices);
+        vertexVals[base + 5] = x; // the normal of a unit sphere is its position
+        vertexVals[base + 6] = y;
+        vertexVals[base + 7] = z;
+    }
+}
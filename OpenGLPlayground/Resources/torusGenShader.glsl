@@ -0,0 +1,65 @@
+#version 430
+
+layout (local_size_x = 64) in;
+
+// interleaved vertices, 8 floats (position, tex coords, normal) or 3 floats (position only) each
+layout (std430, binding = 0) writeonly buffer VertexData
+{
+    float vertexVals[];
+};
+
+uniform int numRings;
+uniform float innerRadius;
+uniform float outerRadius;
+uniform int vertexStride; // in floats
+
+// converts degrees the same way as Utils::toRadians, so the output matches the CPU generator
+float toRadians(float degrees)
+{
+    return (degrees * 2.0 * 3.14159) / 360.0;
+}
+
+// rotation around the Y axis, as done by glm::rotate
+vec3 rotateY(vec3 v, float angle)
+{
+    return vec3(cos(angle) * v.x + sin(angle) * v.z, v.y, -sin(angle) * v.x + cos(angle) * v.z);
+}
+
+void main()
+{
+    int id = int(gl_GlobalInvocationID.x);
+    if (id >= (numRings + 1) * (numRings + 1))
+    {
+        return;
+    }
+    int ring = id / (numRings + 1);
+    int vert = id % (numRings + 1);
+
+    // point on the first ring: rotated around Z, then moved outward
+    float angle = toRadians(float(vert) * 360.0 / float(numRings));
+    vec3 pos = vec3(-sin(angle) * outerRadius, cos(angle) * outerRadius, 0.0) + vec3(innerRadius, 0.0, 0.0);
+
+    // the first tangent is -Y rotated around Z, the second is -Z, their cross product is the normal
+    float tangentAngle = angle + (3.14159 / 2.0);
+    vec3 tTangent = vec3(sin(tangentAngle), -cos(tangentAngle), 0.0);
+    vec3 sTangent = vec3(0.0, 0.0, -1.0);
+    vec3 normal = cross(tTangent, sTangent);
+
+    // rotate the first ring about Y to get this ring
+    float ringAngle = toRadians(float(ring) * 360.0 / float(numRings));
+    pos = rotateY(pos, ringAngle);
+    normal = rotateY(normal, ringAngle);
+
+    int base = id * vertexStride;
+    vertexVals[base + 0] = pos.x;
+    vertexVals[base + 1] = pos.y;
+    vertexVals[base + 2] = pos.z;
+    if (vertexStride == 8)
+    {
+        vertexVals[base + 3] = float(ring) * 2.0 / float(numRings);
+        vertexVals[base + 4] = float(vert) / float(numRings);
+        vertexVals[base + 5] = normal.x;
+        vertexVals[base + 6] = normal.y;
+        vertexVals[base + 7] = normal.z;
+    }
+}
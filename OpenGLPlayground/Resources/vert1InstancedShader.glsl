@@ -0,0 +1,17 @@
+#version 430
+
+layout (location=0) in vec3 aPos;
+layout (location=3) in mat4 aInstanceMatrix; // per instance, takes locations 3 to 6
+
+// bindings match UniformBlocks.h, in this pass sh_mvp_matrix is the light's unbiased MVP of the whole instance group
+layout (std140, binding = 2) uniform ObjectBlock
+{
+    mat3x4 m_matrix; // the transposed affine matrix, its columns are the rows that are not (0, 0, 0, 1)
+    mat3x4 n_matrix; // the same, both multiply a vector from the left
+    mat4 sh_mvp_matrix;
+};
+
+void main()
+{
+	gl_Position = sh_mvp_matrix * aInstanceMatrix * vec4(aPos, 1.0);
+}
\ No newline at end of file
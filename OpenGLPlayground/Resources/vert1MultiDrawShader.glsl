@@ -0,0 +1,22 @@
+#version 430
+
+layout (location=0) in vec3 aPos;
+layout (location=8) in uint aDrawId; // the draw's base instance, selects its entry in ObjectStorage
+
+struct ObjectData
+{
+    mat3x4 m_matrix; // the transposed affine matrix, its columns are the rows that are not (0, 0, 0, 1)
+    mat3x4 n_matrix; // the same, both multiply a vector from the left
+    mat4 sh_mvp_matrix;
+};
+
+// bindings match UniformBlocks.h, in this pass sh_mvp_matrix is the light's unbiased MVP
+layout (std430, binding = 3) readonly buffer ObjectStorage
+{
+    ObjectData objects[];
+};
+
+void main()
+{
+	gl_Position = objects[aDrawId].sh_mvp_matrix * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -2,7 +2,13 @@
 
 layout (location=0) in vec3 aPos;
 
-uniform mat4 sh_mvp_matrix;
+// bindings match UniformBlocks.h, in this pass sh_mvp_matrix is the light's unbiased MVP
+layout (std140, binding = 2) uniform ObjectBlock
+{
+    mat3x4 m_matrix; // the transposed affine matrix, its columns are the rows that are not (0, 0, 0, 1)
+    mat3x4 n_matrix; // the same, both multiply a vector from the left
+    mat4 sh_mvp_matrix;
+};
 
 void main()
 {
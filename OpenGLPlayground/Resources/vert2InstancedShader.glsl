@@ -0,0 +1,75 @@
+#version 430
+
+layout (location=0) in vec3 aPos;
+layout (location=1) in vec2 aTexCoord;
+layout (location=2) in vec3 aNorm;
+layout (location=3) in mat4 aInstanceMatrix; // per instance, takes locations 3 to 6
+layout (location=7) in vec4 aInstanceColor;  // per instance
+
+layout (binding=0) uniform sampler2D texSamp;
+layout (binding=1) uniform sampler2DShadow shadowSamp;
+
+struct PositionalLight
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec3 position;
+};
+
+struct Material
+{ 
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    float shininess;
+};
+
+// bindings match UniformBlocks.h
+layout (std140, binding = 0) uniform FrameBlock
+{
+    mat4 v_matrix;
+    mat4 p_matrix;
+    PositionalLight light;
+    vec4 globalAmb;
+    vec2 windowSize;
+};
+
+layout (std140, binding = 1) uniform MaterialBlock
+{
+    Material material;
+};
+
+// for instanced draws the object block holds the transform of the whole group
+layout (std140, binding = 2) uniform ObjectBlock
+{
+    mat3x4 m_matrix; // the transposed affine matrix, its columns are the rows that are not (0, 0, 0, 1)
+    mat3x4 n_matrix; // the same, both multiply a vector from the left
+    mat4 sh_mvp_matrix;
+};
+
+out vec2 texCoord;          // texture coordinate
+out vec3 varyingNorm;       // world-space vertex normal
+out vec3 varyingLightDir;   // vector pointing to the light
+out vec3 varyingVertPos;    // vertex position in world space
+out vec3 varyingHalfVec;    // vector between L and V
+out vec4 shadow_coord;      // shadow texture coordinates
+out vec4 varyingTint;       // per-instance color, white outside of instanced draws
+invariant gl_Position;      // the depth prepass writes the depth this pass tests for equality
+
+void main()
+{
+    // instances are rotated and uniformly scaled, so their upper 3x3 transforms normals as well
+    vec3 instanceNorm = mat3(aInstanceMatrix) * aNorm;
+
+    // output to the rasterizer for interpolation
+    texCoord = aTexCoord;
+    varyingVertPos = (aInstanceMatrix * vec4(aPos, 1.0)) * m_matrix;
+    varyingLightDir = light.position - varyingVertPos;
+    varyingNorm = vec4(instanceNorm, 0.0) * n_matrix;
+    varyingHalfVec = (varyingLightDir - varyingVertPos).xyz;
+
+    shadow_coord = sh_mvp_matrix * aInstanceMatrix * vec4(aPos, 1.0);
+    gl_Position = p_matrix * v_matrix * vec4(varyingVertPos, 1.0);
+    varyingTint = aInstanceColor;
+}
\ No newline at end of file
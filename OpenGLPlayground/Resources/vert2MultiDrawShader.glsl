@@ -0,0 +1,79 @@
+#version 430
+
+layout (location=0) in vec3 aPos;
+layout (location=1) in vec2 aTexCoord;
+layout (location=2) in vec3 aNorm;
+layout (location=8) in uint aDrawId; // the draw's base instance, selects its entry in ObjectStorage
+
+layout (binding=0) uniform sampler2D texSamp;
+layout (binding=1) uniform sampler2DShadow shadowSamp;
+
+struct PositionalLight
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec3 position;
+};
+
+struct Material
+{ 
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    float shininess;
+};
+
+// bindings match UniformBlocks.h
+layout (std140, binding = 0) uniform FrameBlock
+{
+    mat4 v_matrix;
+    mat4 p_matrix;
+    PositionalLight light;
+    vec4 globalAmb;
+    vec2 windowSize;
+};
+
+layout (std140, binding = 1) uniform MaterialBlock
+{
+    Material material;
+};
+
+struct ObjectData
+{
+    mat3x4 m_matrix; // the transposed affine matrix, its columns are the rows that are not (0, 0, 0, 1)
+    mat3x4 n_matrix; // the same, both multiply a vector from the left
+    mat4 sh_mvp_matrix;
+};
+
+// one entry per draw of the multi-draw call
+layout (std430, binding = 3) readonly buffer ObjectStorage
+{
+    ObjectData objects[];
+};
+
+out vec2 texCoord;          // texture coordinate
+out vec3 varyingNorm;       // world-space vertex normal
+out vec3 varyingLightDir;   // vector pointing to the light
+out vec3 varyingVertPos;    // vertex position in world space
+out vec3 varyingHalfVec;    // vector between L and V
+out vec4 shadow_coord;      // shadow texture coordinates
+out vec4 varyingTint;       // per-instance color, white outside of instanced draws
+invariant gl_Position;      // the depth prepass writes the depth this pass tests for equality
+
+void main()
+{
+    mat3x4 m_matrix = objects[aDrawId].m_matrix;
+    mat3x4 n_matrix = objects[aDrawId].n_matrix;
+
+    // output to the rasterizer for interpolation
+    texCoord = aTexCoord;
+    varyingVertPos = vec4(aPos, 1.0) * m_matrix;
+    varyingLightDir = light.position - varyingVertPos;
+    varyingNorm = vec4(aNorm, 1.0) * n_matrix;
+    varyingHalfVec = (varyingLightDir - varyingVertPos).xyz;
+
+    shadow_coord = objects[aDrawId].sh_mvp_matrix * vec4(aPos, 1.0);
+    gl_Position = p_matrix * v_matrix * vec4(varyingVertPos, 1.0);
+    varyingTint = vec4(1.0);
+}
\ No newline at end of file
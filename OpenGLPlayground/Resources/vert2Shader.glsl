@@ -23,15 +23,27 @@ struct Material
     float shininess;
 };
 
-uniform mat4 m_matrix;
-uniform mat4 v_matrix;
-uniform mat4 p_matrix;
-uniform mat4 n_matrix;
-uniform vec4 globalAmb;
-uniform PositionalLight light;
-uniform Material material;
-uniform mat4 sh_mvp_matrix;
-uniform vec2 windowSize;
+// bindings match UniformBlocks.h
+layout (std140, binding = 0) uniform FrameBlock
+{
+    mat4 v_matrix;
+    mat4 p_matrix;
+    PositionalLight light;
+    vec4 globalAmb;
+    vec2 windowSize;
+};
+
+layout (std140, binding = 1) uniform MaterialBlock
+{
+    Material material;
+};
+
+layout (std140, binding = 2) uniform ObjectBlock
+{
+    mat3x4 m_matrix; // the transposed affine matrix, its columns are the rows that are not (0, 0, 0, 1)
+    mat3x4 n_matrix; // the same, both multiply a vector from the left
+    mat4 sh_mvp_matrix;
+};
 
 out vec2 texCoord;          // texture coordinate
 out vec3 varyingNorm;       // world-space vertex normal
@@ -39,16 +51,19 @@ out vec3 varyingLightDir;   // vector pointing to the light
 out vec3 varyingVertPos;    // vertex position in world space
 out vec3 varyingHalfVec;    // vector between L and V
 out vec4 shadow_coord;      // shadow texture coordinates
+out vec4 varyingTint;       // per-instance color, white outside of instanced draws
+invariant gl_Position;      // the depth prepass writes the depth this pass tests for equality
 
 void main()
 {
     // output to the rasterizer for interpolation
     texCoord = aTexCoord;
-    varyingVertPos = (m_matrix * vec4(aPos, 1.0)).xyz;
+    varyingVertPos = vec4(aPos, 1.0) * m_matrix;
     varyingLightDir = light.position - varyingVertPos;
-    varyingNorm = (n_matrix * vec4(aNorm, 1.0)).xyz;
+    varyingNorm = vec4(aNorm, 1.0) * n_matrix;
     varyingHalfVec = (varyingLightDir - varyingVertPos).xyz;
 
     shadow_coord = sh_mvp_matrix * vec4(aPos, 1.0);
-    gl_Position = p_matrix * v_matrix * m_matrix * vec4(aPos, 1.0);
+    gl_Position = p_matrix * v_matrix * vec4(varyingVertPos, 1.0);
+    varyingTint = vec4(1.0);
 }
\ No newline at end of file
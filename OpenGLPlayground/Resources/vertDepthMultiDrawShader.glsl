@@ -0,0 +1,46 @@
+#version 430
+
+layout (location=0) in vec3 aPos;
+layout (location=8) in uint aDrawId; // the draw's base instance, selects its entry in ObjectStorage
+
+struct PositionalLight
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec3 position;
+};
+
+// bindings match UniformBlocks.h
+layout (std140, binding = 0) uniform FrameBlock
+{
+    mat4 v_matrix;
+    mat4 p_matrix;
+    PositionalLight light;
+    vec4 globalAmb;
+    vec2 windowSize;
+};
+
+struct ObjectData
+{
+    mat3x4 m_matrix; // the transposed affine matrix, its columns are the rows that are not (0, 0, 0, 1)
+    mat3x4 n_matrix; // the same, both multiply a vector from the left
+    mat4 sh_mvp_matrix;
+};
+
+// one entry per draw of the multi-draw call
+layout (std430, binding = 3) readonly buffer ObjectStorage
+{
+    ObjectData objects[];
+};
+
+// the camera depth prepass: the lit pass then shades only what these positions leave in the depth buffer, with
+// GL_EQUAL, so they are computed exactly like in vert2MultiDrawShader.glsl, which declares gl_Position invariant too
+invariant gl_Position;
+
+void main()
+{
+    mat3x4 m_matrix = objects[aDrawId].m_matrix;
+    vec3 vertPos = vec4(aPos, 1.0) * m_matrix;
+    gl_Position = p_matrix * v_matrix * vec4(vertPos, 1.0);
+}
\ No newline at end of file